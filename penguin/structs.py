@@ -1,18 +1,46 @@
 import collections
+import importlib
+import sys
 
+# result types are C struct sequences, defined by the modules that return
+# them. like the namedtuples they replaced they can be built from their fields
+# (positionally or by name), as well as from a single sequence of them.
+_homes = {
+    "itimerspec": "penguin.fds",
+    "siginfo": "penguin.fds",
+    "signalfd_siginfo": "penguin.fds",
+    "inotify_event": "penguin.fds",
+    "inotify_rename": "penguin.fds",
+    "tree_event": "penguin.fds",
+    "fanotify_event": "penguin.fds",
+    "ipc_perm": "penguin.sysv_ipc",
+    "msqid_ds": "penguin.sysv_ipc",
+    "semid_ds": "penguin.sysv_ipc",
+    "shmid_ds": "penguin.sysv_ipc",
+    "msginfo": "penguin.sysv_ipc",
+    "seminfo": "penguin.sysv_ipc",
+    "shm_info": "penguin.sysv_ipc",
+    "mq_attr": "penguin.posix_ipc",
+}
 
-itimerspec = collections.namedtuple("itimerspec", "it_value it_interval")
-siginfo = collections.namedtuple("siginfo", "ssi_signum ssi_code")
-ipc_perm = collections.namedtuple("ipc_perm",
-        "key uid gid cuid cgid mode seq")
-msqid_ds = collections.namedtuple("msqid_ds",
-        "msg_perm msg_stime msg_rtime msg_ctime msg_cbytes msg_qnum " +
-        "msg_qbytes msg_lspid msg_lrpid")
-semid_ds = collections.namedtuple("semid_ds",
-        "sem_perm sem_otime sem_ctime sem_nsems")
-shmid_ds = collections.namedtuple("shmid_ds",
-        "shm_perm shm_segsz shm_atime shm_dtime shm_ctime shm_cpid shm_lpid " +
-        "shm_nattch")
+
+def __getattr__(name):
+    # only import the extension a type lives in once it's asked for
+    if name not in _homes:
+        raise AttributeError("module %r has no attribute %r" %
+                (__name__, name))
+    value = getattr(importlib.import_module(_homes[name]), name)
+    globals()[name] = value
+    return value
+
+
+if sys.version_info < (3, 7):
+    # no module __getattr__ before PEP 562
+    for _name in _homes:
+        __getattr__(_name)
+
+
+# these are built by callers and passed in, so they stay namedtuples
 msg_setinfo = collections.namedtuple("msg_setinfo",
         "msg_qbytes perm_uid perm_gid perm_mode")
 sem_setinfo = collections.namedtuple("sem_setinfo",
@@ -20,14 +48,3 @@ sem_setinfo = collections.namedtuple("sem_setinfo",
 shm_setinfo = collections.namedtuple("shm_setinfo",
         "perm_uid perm_gid perm_mode")
 sembuf = collections.namedtuple("sembuf", "sem_num sem_op sem_flg")
-msginfo = collections.namedtuple("msginfo",
-        "msgpool msgmap msgmax msgmnb msgmni msgssz msgtql msgseg")
-seminfo = collections.namedtuple("seminfo",
-        "semmap semmni semmns semmnu semmsl semopm semume semusz semvmx semaem")
-shm_info = collections.namedtuple("shm_info",
-        "used_ids shm_tot shm_rss shm_swp")
-
-mq_attr = collections.namedtuple("mq_attr",
-        "mq_flags mq_maxmsg mq_msgsize mq_curmsgs")
-
-inotify_event = collections.namedtuple("inotify_event", "wd mask cookie name")
@@ -19,13 +19,16 @@ setup(
         Extension('penguin.fds',
             ['src/fds.c'],
             extra_compile_args=["-I."]),
+        Extension('penguin.loop',
+            ['src/loop.c'],
+            extra_compile_args=["-I."]),
         Extension('penguin.signals',
             ['src/signals.c'],
             extra_compile_args=["-I."]),
         Extension('penguin.posix_aio',
             ['src/posix_aio.c'],
             extra_compile_args=["-I."],
-            extra_link_args=['-laio', '-lrt']),
+            extra_link_args=['-laio', '-lrt', '-lpthread']),
         Extension('penguin.linux_kaio',
             ['src/linux_kaio.c'],
             extra_compile_args=["-I.", "-idirafter", "./src/missing-headers"],
@@ -36,6 +39,6 @@ setup(
         Extension('penguin.posix_ipc',
             ['src/posix_ipc.c'],
             extra_compile_args=["-I."],
-            extra_link_args=['-lrt']),
+            extra_link_args=['-lrt', '-lpthread']),
     ],
 )
@@ -7,5 +7,8 @@
     #define PyNumber_Int               PyNumber_Long
     #define PyString_FromStringAndSize PyBytes_FromStringAndSize
     #define PyString_FromString        PyBytes_FromString
+    #define PyString_AS_STRING         PyBytes_AS_STRING
+    #define PyString_GET_SIZE          PyBytes_GET_SIZE
+    #define _PyString_Resize           _PyBytes_Resize
     #define PyInt_Check(o)             0
 #endif
@@ -1,12 +1,138 @@
 #include "common.h"
+#include "structseq.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/eventfd.h>
 #include <sys/timerfd.h>
 #include <sys/signalfd.h>
 #include <asm/unistd.h>
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <stdarg.h>
+
+
+/*
+ * result types
+ *
+ * these are also exported as penguin.structs.*. struct sequences are tuples
+ * with named fields like namedtuples, but are built in C with no python call.
+ */
+
+static PyStructSequence_Field itimerspec_fields[] = {
+    {"it_value", NULL}, {"it_interval", NULL}, {NULL}
+};
+static PyStructSequence_Desc itimerspec_desc = {
+    "penguin.fds.itimerspec", "a timer setting, in seconds",
+    itimerspec_fields, 2
+};
+static PyTypeObject itimerspec_type;
+
+static PyStructSequence_Field siginfo_fields[] = {
+    {"ssi_signum", NULL}, {"ssi_code", NULL}, {NULL}
+};
+static PyStructSequence_Desc siginfo_desc = {
+    "penguin.fds.siginfo", "a signal read from a signalfd",
+    siginfo_fields, 2
+};
+static PyTypeObject siginfo_type;
+
+static PyStructSequence_Field signalfd_siginfo_fields[] = {
+    {"ssi_signo", NULL}, {"ssi_errno", NULL}, {"ssi_code", NULL},
+    {"ssi_pid", NULL}, {"ssi_uid", NULL}, {"ssi_fd", NULL}, {"ssi_tid", NULL},
+    {"ssi_band", NULL}, {"ssi_overrun", NULL}, {"ssi_trapno", NULL},
+    {"ssi_status", NULL}, {"ssi_int", NULL}, {"ssi_ptr", NULL},
+    {"ssi_utime", NULL}, {"ssi_stime", NULL}, {"ssi_addr", NULL}, {NULL}
+};
+static PyStructSequence_Desc signalfd_siginfo_desc = {
+    "penguin.fds.signalfd_siginfo", "every field of a signalfd_siginfo",
+    signalfd_siginfo_fields, 16
+};
+static PyTypeObject signalfd_siginfo_type;
+
+static PyStructSequence_Field inotify_event_fields[] = {
+    {"wd", NULL}, {"mask", NULL}, {"cookie", NULL}, {"name", NULL}, {NULL}
+};
+static PyStructSequence_Desc inotify_event_desc = {
+    "penguin.fds.inotify_event", "an event read from an inotify instance",
+    inotify_event_fields, 4
+};
+static PyTypeObject inotify_event_type;
+
+static PyStructSequence_Field inotify_rename_fields[] = {
+    {"from_wd", NULL}, {"from_name", NULL}, {"to_wd", NULL},
+    {"to_name", NULL}, {"mask", NULL}, {"cookie", NULL}, {NULL}
+};
+static PyStructSequence_Desc inotify_rename_desc = {
+    "penguin.fds.inotify_rename", "a paired IN_MOVED_FROM and IN_MOVED_TO",
+    inotify_rename_fields, 6
+};
+static PyTypeObject inotify_rename_type;
+
+static PyStructSequence_Field tree_event_fields[] = {
+    {"path", NULL}, {"mask", NULL}, {"cookie", NULL}, {NULL}
+};
+static PyStructSequence_Desc tree_event_desc = {
+    "penguin.fds.tree_event", "an event read from a TreeWatcher",
+    tree_event_fields, 3
+};
+static PyTypeObject tree_event_type;
+
+static PyStructSequence_Field fanotify_event_fields[] = {
+    {"mask", NULL}, {"fd", NULL}, {"pid", NULL}, {"fsid", NULL},
+    {"handle", NULL}, {"name", NULL}, {NULL}
+};
+static PyStructSequence_Desc fanotify_event_desc = {
+    "penguin.fds.fanotify_event", "an event read from a fanotify group",
+    fanotify_event_fields, 6
+};
+static PyTypeObject fanotify_event_type;
+
+static int struct_types_ready = 0;
+
+/* build a struct sequence from n new references, any of which may be NULL */
+static PyObject *
+new_struct_seq(PyTypeObject *type, int n, ...) {
+    PyObject *seq, *item;
+    va_list items;
+    int i, failed;
+
+    seq = PyStructSequence_New(type);
+    failed = NULL == seq;
+
+    va_start(items, n);
+    for (i = 0; i < n; ++i) {
+        item = va_arg(items, PyObject *);
+        if (failed || NULL == item) {
+            failed = 1;
+            Py_XDECREF(item);
+        } else
+            PyStructSequence_SET_ITEM(seq, i, item);
+    }
+    va_end(items);
+
+    if (failed) {
+        Py_XDECREF(seq);
+        return NULL;
+    }
+    return seq;
+}
+
+/* a new reference to a string, or to None for NULL */
+static PyObject *
+string_or_none(const char *str) {
+    if (NULL == str) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyString_FromString(str);
+}
 
 
 /*
@@ -25,7 +151,7 @@ python_eventfd(PyObject *module, PyObject *args, PyObject *kwargs) {
                 &initval, &flags))
         return NULL;
 
-    if (!(fd = eventfd(initval, flags))) {
+    if ((fd = eventfd(initval, flags)) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
@@ -85,52 +211,319 @@ python_write_eventfd(PyObject *module, PyObject *args) {
     Py_INCREF(Py_None);
     return Py_None;
 }
-#endif /* EVENTFD_MISSING */
 
 
 /*
- * timerfd
+ * Eventfd objects
+ *
+ * reads and writes of an eventfd are always exactly 8 bytes, and one that's
+ * nonblocking can't stall, so for those the GIL is kept across the syscall
+ * rather than paying to release and reacquire it. O_NONBLOCK can be changed
+ * with fcntl() after creation, so it's looked up rather than remembered.
  */
 
-/* set this to penguin.structs.itimerspec at c module import time */
-static PyObject *PyItimerspec = NULL;
-static PyObject *PySiginfo = NULL;
-static PyObject *PyInotifyEvent = NULL;
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    char semaphore;
+} python_eventfd_object;
 
-#ifndef TIMERFD_MISSING
 static PyObject *
-unwrap_timer(const struct itimerspec *spec) {
-    double timeout, interval;
-    PyObject *pytimeout, *pyinterval, *args, *pyspec;
+python_eventfd_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_eventfd_object *self;
+    unsigned int initval = 0;
+    int flags = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Ii", eventfd_kwargs,
+                &initval, &flags))
+        return NULL;
+
+    if (!(self = (python_eventfd_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->semaphore = !!(flags & EFD_SEMAPHORE);
+    if ((self->fd = eventfd(initval, flags)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+static void
+python_eventfd_dealloc(python_eventfd_object *self) {
+    if (self->fd >= 0)
+        close(self->fd);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+eventfd_check(python_eventfd_object *self) {
+    if (self->fd < 0) {
+        PyErr_SetString(PyExc_ValueError, "Eventfd is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 if the fd is currently nonblocking, 0 if not, -1 with an exception set */
+static int
+eventfd_nonblocking(python_eventfd_object *self) {
+    int flags;
+
+    if ((flags = fcntl(self->fd, F_GETFL)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return !!(flags & O_NONBLOCK);
+}
+
+/* 0 on success, 1 on EAGAIN, -1 with an exception set */
+static int
+eventfd_io(python_eventfd_object *self, uint64_t *value, int writing) {
+    ssize_t length;
+    int nonblocking;
+
+    for (;;) {
+        if ((nonblocking = eventfd_nonblocking(self)) < 0)
+            return -1;
+
+        if (nonblocking) {
+            length = writing ? write(self->fd, value, 8) :
+                read(self->fd, value, 8);
+        } else {
+            Py_BEGIN_ALLOW_THREADS
+            length = writing ? write(self->fd, value, 8) :
+                read(self->fd, value, 8);
+            Py_END_ALLOW_THREADS
+        }
+
+        if (length >= 0)
+            return 0;
+        if (EAGAIN == errno)
+            return 1;
+        if (EINTR != errno) {
+            PyErr_SetFromErrno(PyExc_IOError);
+            return -1;
+        }
+        /* a signal handler may have closed us */
+        if (PyErr_CheckSignals() || eventfd_check(self))
+            return -1;
+    }
+}
+
+static PyObject *
+python_eventfd_notify(python_eventfd_object *self, PyObject *iamnull) {
+    uint64_t value = 1;
+
+    if (eventfd_check(self))
+        return NULL;
+
+    /* EAGAIN means the counter is saturated, so it's readable already */
+    if (eventfd_io(self, &value, 1) < 0)
+        return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_eventfd_add(python_eventfd_object *self, PyObject *pyvalue) {
+    uint64_t value;
+    int rc;
+
+    value = (uint64_t)PyLong_AsUnsignedLongLong(pyvalue);
+    if (PyErr_Occurred())
+        return NULL;
+
+    if (eventfd_check(self))
+        return NULL;
+
+    if ((rc = eventfd_io(self, &value, 1)) < 0)
+        return NULL;
+
+    return PyBool_FromLong(!rc);
+}
+
+static PyObject *
+python_eventfd_drain(python_eventfd_object *self, PyObject *iamnull) {
+    uint64_t value = 0;
+
+    if (eventfd_check(self))
+        return NULL;
+
+    if (eventfd_io(self, &value, 0) < 0)
+        return NULL;
+
+    return PyLong_FromUnsignedLongLong((unsigned PY_LONG_LONG)value);
+}
+
+static PyObject *
+python_eventfd_acquire(python_eventfd_object *self, PyObject *pyn) {
+    long n, acquired;
+    uint64_t value;
+    struct pollfd pfd;
+    int rc, nonblocking;
+
+    if (-1 == (n = PyInt_AsLong(pyn)) && PyErr_Occurred())
+        return NULL;
 
-    timeout = spec->it_value.tv_sec + (spec->it_value.tv_nsec / 1E9);
-    if (NULL == (pytimeout = PyFloat_FromDouble(timeout)))
+    if (eventfd_check(self))
         return NULL;
 
-    interval = spec->it_interval.tv_sec + (spec->it_interval.tv_nsec / 1E9);
-    if (NULL == (pyinterval = PyFloat_FromDouble(interval))) {
-        Py_DECREF(pytimeout);
+    if (!self->semaphore) {
+        PyErr_SetString(PyExc_ValueError,
+                "acquire requires an EFD_SEMAPHORE eventfd");
         return NULL;
     }
 
-    if (NULL == (args = PyTuple_New(2))) {
-        Py_DECREF(pytimeout);
-        Py_DECREF(pyinterval);
+    if ((nonblocking = eventfd_nonblocking(self)) < 0)
         return NULL;
+
+    /* each read takes one unit. only the first may block, the rest stop as
+     * soon as the count runs out */
+    pfd.events = POLLIN;
+    for (acquired = 0; acquired < n; ++acquired) {
+        pfd.fd = self->fd;
+        if (acquired && !nonblocking && poll(&pfd, 1, 0) <= 0)
+            break;
+        if ((rc = eventfd_io(self, &value, 0)) < 0)
+            return NULL;
+        if (rc)
+            break;
     }
 
-    PyTuple_SET_ITEM(args, 0, pytimeout);
-    PyTuple_SET_ITEM(args, 1, pyinterval);
+    return PyInt_FromLong(acquired);
+}
 
-    if (NULL == PyItimerspec)
-        return args;
+static PyObject *
+python_eventfd_fileno(python_eventfd_object *self, PyObject *iamnull) {
+    return PyInt_FromLong((long)self->fd);
+}
 
-    pyspec = PyObject_Call(PyItimerspec, args, NULL);
-    Py_DECREF(args);
-    if (NULL == pyspec)
+static PyObject *
+python_eventfd_close(python_eventfd_object *self, PyObject *iamnull) {
+    if (self->fd >= 0 && close(self->fd) < 0) {
+        self->fd = -1;
+        PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
+    }
+    self->fd = -1;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-    return pyspec;
+static PyMethodDef eventfd_methods[] = {
+    {"notify", (PyCFunction)python_eventfd_notify, METH_NOARGS,
+        "add 1 to the counter, waking up a reader\n\
+\n\
+a counter already at its maximum is left as it is, as it's readable anyway\n\
+"},
+    {"add", (PyCFunction)python_eventfd_add, METH_O,
+        "add to the counter\n\
+\n\
+:param int value: the amount to add\n\
+\n\
+:returns:\n\
+    True, or False if the fd is nonblocking and adding would overflow the\n\
+    counter\n\
+"},
+    {"drain", (PyCFunction)python_eventfd_drain, METH_NOARGS,
+        "read the counter, resetting it to 0\n\
+\n\
+with ``EFD_SEMAPHORE`` this takes a single unit instead (see\n\
+:meth:`acquire`).\n\
+\n\
+:returns:\n\
+    the counter's value, or 0 if the fd is nonblocking and the counter was\n\
+    already 0\n\
+"},
+    {"acquire", (PyCFunction)python_eventfd_acquire, METH_O,
+        "take up to ``n`` units from an ``EFD_SEMAPHORE`` eventfd\n\
+\n\
+for a blocking fd this waits for the first unit, but no further.\n\
+\n\
+:param int n: the most units to take\n\
+\n\
+:returns: the number of units taken\n\
+"},
+    {"fileno", (PyCFunction)python_eventfd_fileno, METH_NOARGS,
+        "get the file descriptor\n\
+\n\
+:returns: integer file descriptor, for use with select/poll/epoll\n\
+"},
+    {"close", (PyCFunction)python_eventfd_close, METH_NOARGS,
+        "close the file descriptor\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_eventfd_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.fds.Eventfd",                     /* tp_name */
+    sizeof(python_eventfd_object),             /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_eventfd_dealloc,        /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    0,                                         /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "Eventfd(initval=0, flags=0)\n\
+\n\
+an eventfd, closed when the object is garbage collected\n\
+\n\
+``initval`` and ``flags`` are as for :func:`eventfd`.",  /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    eventfd_methods,                           /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_eventfd_new,                        /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+#endif /* EVENTFD_MISSING */
+
+
+/*
+ * timerfd
+ */
+
+#ifndef TIMERFD_MISSING
+static PyObject *
+unwrap_timer(const struct itimerspec *spec) {
+    return new_struct_seq(&itimerspec_type, 2,
+            PyFloat_FromDouble(
+                spec->it_value.tv_sec + (spec->it_value.tv_nsec / 1E9)),
+            PyFloat_FromDouble(
+                spec->it_interval.tv_sec + (spec->it_interval.tv_nsec / 1E9)));
 }
 
 static void
@@ -163,7 +556,8 @@ python_timerfd_create(PyObject *module, PyObject *args) {
     return PyInt_FromLong((long)fd);
 }
 
-static char *timerfd_settime_kwargs[] = {"interval", "absolute", NULL};
+static char *timerfd_settime_kwargs[] = {
+    "fd", "timeout", "interval", "absolute", NULL};
 
 static PyObject *
 python_timerfd_settime(PyObject *module, PyObject *args, PyObject *kwargs) {
@@ -205,236 +599,2154 @@ python_timerfd_gettime(PyObject *module, PyObject *args) {
 
     return unwrap_timer(&spec);
 }
-#endif /* TIMERFD_MISSING */
-
 
-#ifndef SIGNALFD_MISSING
 /*
- * signalfd
+ * the _ns variants take and return integer nanoseconds, so absolute
+ * CLOCK_REALTIME deadlines survive the round trip, and plain tuples
  */
 
-static int
-wrap_sigset(sigset_t *set, PyObject *signals) {
-    int signum;
-    PyObject *iter, *item, *pysignum;
+static void
+ns_to_timespec(PY_LONG_LONG ns, struct timespec *ts) {
+    ts->tv_sec = (time_t)(ns / 1000000000);
+    ts->tv_nsec = (long)(ns % 1000000000);
+}
 
-    if (NULL == (iter = PyObject_GetIter(signals)))
-        return -1;
+static PY_LONG_LONG
+timespec_to_ns(const struct timespec *ts) {
+    return (PY_LONG_LONG)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
 
-    while ((item = PyIter_Next(iter))) {
-        if (NULL == (pysignum = PyNumber_Int(item))) {
-            Py_DECREF(iter);
-            Py_DECREF(item);
-            return -1;
-        }
+static char *timerfd_settime_ns_kwargs[] = {
+    "fd", "value", "interval", "absolute", NULL};
 
-        if (-1 == (signum = PyInt_AsLong(pysignum)) && PyErr_Occurred()) {
-            Py_DECREF(iter);
-            Py_DECREF(item);
-            Py_DECREF(pysignum);
-            return -1;
-        }
+static PyObject *
+python_timerfd_settime_ns(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int fd, flags = 0;
+    PY_LONG_LONG value, interval = 0;
+    struct itimerspec inspec, outspec;
+    PyObject *absolute = Py_False;
 
-        if (sigaddset(set, signum) < 0) {
-            Py_DECREF(iter);
-            Py_DECREF(item);
-            Py_DECREF(pysignum);
-            PyErr_SetFromErrno(PyExc_OSError);
-            return -1;
-        }
+    if (!PyArg_ParseTupleAndKeywords(
+                args, kwargs, "iL|LO", timerfd_settime_ns_kwargs,
+                &fd, &value, &interval, &absolute))
+        return NULL;
 
-        Py_DECREF(item);
-        Py_DECREF(pysignum);
+    if (value < 0 || interval < 0) {
+        PyErr_SetString(PyExc_ValueError, "times must be non-negative");
+        return NULL;
     }
-    Py_DECREF(iter);
 
-    return 0;
+    ns_to_timespec(value, &inspec.it_value);
+    ns_to_timespec(interval, &inspec.it_interval);
+
+    if (PyObject_IsTrue(absolute))
+        flags |= TFD_TIMER_ABSTIME;
+
+    if (timerfd_settime(fd, flags, &inspec, &outspec) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return Py_BuildValue("(LL)", timespec_to_ns(&outspec.it_value),
+            timespec_to_ns(&outspec.it_interval));
 }
 
 static PyObject *
-unwrap_siginfo(struct signalfd_siginfo *info) {
-    PyObject *args, *item, *result;
+python_timerfd_gettime_ns(PyObject *module, PyObject *args) {
+    int fd;
+    struct itimerspec spec;
 
-    if (NULL == (args = PyTuple_New(2)))
+    if (!PyArg_ParseTuple(args, "i", &fd))
         return NULL;
 
-    if (NULL == (item = PyInt_FromLong((long)(info->ssi_signo)))) {
-        Py_DECREF(args);
+    if (timerfd_gettime(fd, &spec) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
-    PyTuple_SET_ITEM(args, 0, item);
 
-    if (NULL == (item = PyInt_FromLong((long)(info->ssi_code)))) {
-        Py_DECREF(args);
+    return Py_BuildValue("(LL)", timespec_to_ns(&spec.it_value),
+            timespec_to_ns(&spec.it_interval));
+}
+
+static PyObject *
+python_read_timerfd(PyObject *module, PyObject *args) {
+    int fd;
+    uint64_t expirations;
+    ssize_t length;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
         return NULL;
-    }
-    PyTuple_SET_ITEM(args, 1, item);
 
-    if (NULL == PySiginfo)
-        return args;
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, &expirations, sizeof(expirations));
+    Py_END_ALLOW_THREADS
 
-    result = PyObject_Call(PySiginfo, args, NULL);
-    Py_DECREF(args);
-    if (NULL == result)
+    if (length < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
+    }
 
-    return result;
+    return PyLong_FromUnsignedLongLong((unsigned PY_LONG_LONG)expirations);
 }
+#endif /* TIMERFD_MISSING */
 
-static PyObject *
-python_signalfd(PyObject *module, PyObject *args) {
-    int fd, flags = 0;
-    sigset_t mask;
-    PyObject *signals, *result;
 
-    sigemptyset(&mask);
+/*
+ * timer wheel
+ *
+ * TimerWheel multiplexes any number of timers onto a single timerfd. timers
+ * live in a pool indexed by the low 32 bits of their ids (the high 32 are a
+ * generation count, so stale ids are detected) and are linked into a
+ * four-level hierarchical wheel of 256 slots per level, counted in ticks of
+ * the wheel's resolution since it was created. level 0 holds timers due in
+ * the next 256 ticks, one slot per tick; each higher level covers 256 times
+ * the span of the one below and is cascaded down a slot at a time as the
+ * lower level wraps. the timerfd is only ever armed (with an absolute time)
+ * to the earliest slot that needs attention.
+ */
 
-    if (!PyArg_ParseTuple(args, "iO|i", &fd, &signals, &flags))
-        return NULL;
+#ifndef TIMERFD_MISSING
 
-    if (wrap_sigset(&mask, signals))
-        return NULL;
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_NIL -1
+#define WHEEL_NEVER UINT64_MAX
+
+typedef struct {
+    uint64_t expires;
+    int32_t next;
+    int32_t prev;
+    uint32_t gen;
+    int16_t level; /* -1 while on the free list */
+    uint16_t slot;
+    PyObject *token;
+} wheel_timer;
+
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    clockid_t clockid;
+    uint64_t resolution; /* nanoseconds per tick */
+    uint64_t base; /* clock reading at tick 0, in nanoseconds */
+    uint64_t current; /* the next tick to be processed */
+    uint64_t armed; /* tick the timerfd is set for */
+    wheel_timer *timers;
+    uint32_t capacity;
+    uint32_t live;
+    int32_t free;
+    int32_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS][WHEEL_SLOTS / 64];
+} python_timerwheel_object;
+
+static int
+wheel_now(python_timerwheel_object *self, uint64_t *now) {
+    struct timespec ts;
+
+    if (clock_gettime(self->clockid, &ts) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    *now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return 0;
+}
+
+/* first occupied slot at or after index 'from' in a level, or -1 */
+static int
+wheel_next_slot(python_timerwheel_object *self, int level, int from) {
+    int word;
+    uint64_t bits;
+
+    for (word = from / 64; word < WHEEL_SLOTS / 64; ++word) {
+        bits = self->occupied[level][word];
+        if (word == from / 64)
+            bits &= ~(uint64_t)0 << (from % 64);
+        if (bits)
+            return word * 64 + __builtin_ctzll(bits);
+    }
+    return -1;
+}
+
+static void
+wheel_link(python_timerwheel_object *self, int32_t index) {
+    wheel_timer *timer = &self->timers[index];
+    uint64_t delta;
+    int level, slot;
+
+    if (timer->expires <= self->current) {
+        level = 0;
+        slot = self->current & WHEEL_MASK;
+    } else {
+        delta = timer->expires - self->current;
+        for (level = 0; level < WHEEL_LEVELS - 1; ++level)
+            if (delta < (uint64_t)1 << (WHEEL_BITS * (level + 1)))
+                break;
+
+        /* beyond the wheel's span, park it in the top level's furthest
+         * slot and let the cascade place it again when that comes around */
+        if (delta >> (WHEEL_BITS * WHEEL_LEVELS))
+            slot = ((self->current + ((uint64_t)1 << (WHEEL_BITS *
+                    WHEEL_LEVELS)) - 1) >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        else
+            slot = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    }
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = WHEEL_NIL;
+    timer->next = self->slots[level][slot];
+    if (WHEEL_NIL != timer->next)
+        self->timers[timer->next].prev = index;
+    self->slots[level][slot] = index;
+    self->occupied[level][slot / 64] |= (uint64_t)1 << (slot % 64);
+}
+
+static void
+wheel_unlink(python_timerwheel_object *self, int32_t index) {
+    wheel_timer *timer = &self->timers[index];
+
+    if (WHEEL_NIL != timer->prev)
+        self->timers[timer->prev].next = timer->next;
+    else
+        self->slots[timer->level][timer->slot] = timer->next;
+
+    if (WHEEL_NIL != timer->next)
+        self->timers[timer->next].prev = timer->prev;
+
+    if (WHEEL_NIL == self->slots[timer->level][timer->slot])
+        self->occupied[timer->level][timer->slot / 64] &=
+            ~((uint64_t)1 << (timer->slot % 64));
+}
+
+/* detach a whole slot, returning the head of its list */
+static int32_t
+wheel_take_slot(python_timerwheel_object *self, int level, int slot) {
+    int32_t head = self->slots[level][slot];
+
+    self->slots[level][slot] = WHEEL_NIL;
+    self->occupied[level][slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    return head;
+}
+
+static void
+wheel_release(python_timerwheel_object *self, int32_t index) {
+    wheel_timer *timer = &self->timers[index];
+
+    timer->level = -1;
+    timer->token = NULL;
+    timer->gen++;
+    timer->next = self->free;
+    self->free = index;
+    self->live--;
+}
+
+static int32_t
+wheel_alloc(python_timerwheel_object *self) {
+    wheel_timer *timers;
+    uint32_t i, capacity;
+    int32_t index;
+
+    if (WHEEL_NIL == self->free) {
+        if (self->capacity >= INT32_MAX / 2) {
+            PyErr_SetString(PyExc_OverflowError, "too many timers");
+            return WHEEL_NIL;
+        }
+        capacity = self->capacity ? self->capacity * 2 : 64;
+        if (!(timers = realloc(self->timers, capacity * sizeof(wheel_timer)))) {
+            PyErr_NoMemory();
+            return WHEEL_NIL;
+        }
+        for (i = capacity; i > self->capacity; --i) {
+            timers[i - 1].level = -1;
+            timers[i - 1].gen = 0;
+            timers[i - 1].token = NULL;
+            timers[i - 1].next = self->free;
+            self->free = i - 1;
+        }
+        self->timers = timers;
+        self->capacity = capacity;
+    }
+
+    index = self->free;
+    self->free = self->timers[index].next;
+    self->live++;
+    return index;
+}
+
+static int
+wheel_lookup(python_timerwheel_object *self, unsigned PY_LONG_LONG id) {
+    uint32_t index = (uint32_t)id;
+
+    if (index >= self->capacity || self->timers[index].level < 0 ||
+            self->timers[index].gen != (uint32_t)(id >> 32))
+        return WHEEL_NIL;
+    return (int32_t)index;
+}
+
+static uint64_t
+wheel_ticks(python_timerwheel_object *self, double timeout, uint64_t now) {
+    uint64_t ticks;
+
+    if (timeout < 0)
+        timeout = 0;
+    if (timeout * 1E9 >= (double)(UINT64_MAX / 2))
+        return WHEEL_NEVER - 1;
+
+    /* round up, so a timer never fires early */
+    ticks = now - self->base + (uint64_t)(timeout * 1E9) +
+        self->resolution - 1;
+    return ticks / self->resolution;
+}
+
+/* the earliest tick at which some slot needs firing or cascading */
+static uint64_t
+wheel_next_tick(python_timerwheel_object *self) {
+    uint64_t best = WHEEL_NEVER, tick, position;
+    int level, index, slot, shift, pending;
+
+    if (!self->live)
+        return WHEEL_NEVER;
+
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        shift = WHEEL_BITS * level;
+        position = self->current >> shift;
+        index = position & WHEEL_MASK;
+
+        /* the slot at the current index is still to be fired or cascaded
+         * if the current tick is where that happens. otherwise it already
+         * has been, and what's in it now comes around a rotation later. */
+        pending = !(self->current & (((uint64_t)1 << shift) - 1));
+        if (!pending) index = (index + 1) & WHEEL_MASK;
+
+        if ((slot = wheel_next_slot(self, level, index)) < 0 &&
+                (slot = wheel_next_slot(self, level, 0)) < 0)
+            continue;
+
+        tick = ((position & ~(uint64_t)WHEEL_MASK) | slot);
+        if (tick < position || (!pending && tick == position))
+            tick += WHEEL_SLOTS;
+        tick <<= shift;
+
+        if (tick < best) best = tick;
+    }
+
+    return best;
+}
+
+static int
+wheel_arm(python_timerwheel_object *self) {
+    struct itimerspec spec;
+    uint64_t tick, when;
+
+    tick = wheel_next_tick(self);
+    if (tick == self->armed)
+        return 0;
+
+    memset(&spec, 0, sizeof(spec));
+    if (WHEEL_NEVER != tick) {
+        when = self->base + tick * self->resolution;
+        spec.it_value.tv_sec = when / 1000000000;
+        spec.it_value.tv_nsec = when % 1000000000;
+    }
+
+    if (timerfd_settime(self->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    self->armed = tick;
+    return 0;
+}
+
+static void
+wheel_cascade(python_timerwheel_object *self, int level) {
+    int32_t index, next;
+    int slot = (self->current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    for (index = wheel_take_slot(self, level, slot); WHEEL_NIL != index;
+            index = next) {
+        next = self->timers[index].next;
+        wheel_link(self, index);
+    }
+}
+
+/* process every tick up to and including 'now', moving due tokens to list */
+static int
+wheel_advance(python_timerwheel_object *self, uint64_t now, PyObject *list) {
+    int32_t index, next;
+    int level, slot;
+    uint64_t target;
+
+    while (self->current <= now) {
+        if (!self->live) {
+            self->current = now + 1;
+            break;
+        }
+
+        if (!(self->current & WHEEL_MASK)) {
+            for (level = 1; level < WHEEL_LEVELS - 1; ++level)
+                if (self->current & (((uint64_t)1 <<
+                                (WHEEL_BITS * (level + 1))) - 1))
+                    break;
+            for (; level > 0; --level)
+                wheel_cascade(self, level);
+        }
+
+        slot = self->current & WHEEL_MASK;
+        for (index = wheel_take_slot(self, 0, slot); WHEEL_NIL != index;
+                index = next) {
+            next = self->timers[index].next;
+            if (PyList_Append(list, self->timers[index].token)) {
+                /* put back what hasn't been handed out yet */
+                for (; WHEEL_NIL != index; index = next) {
+                    next = self->timers[index].next;
+                    wheel_link(self, index);
+                }
+                return -1;
+            }
+            Py_DECREF(self->timers[index].token);
+            wheel_release(self, index);
+        }
+
+        /* jump straight to the next occupied slot or cascade point */
+        if (slot < WHEEL_MASK &&
+                (slot = wheel_next_slot(self, 0, slot + 1)) >= 0)
+            target = (self->current & ~(uint64_t)WHEEL_MASK) | slot;
+        else
+            target = (self->current | WHEEL_MASK) + 1;
+        self->current = target <= now ? target : now + 1;
+    }
+
+    return 0;
+}
+
+static char *timerwheel_kwargs[] = {"clockid", "resolution", NULL};
+
+static PyObject *
+python_timerwheel_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_timerwheel_object *self;
+    int clockid = CLOCK_MONOTONIC, level;
+    double resolution = 0.001;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|id", timerwheel_kwargs,
+                &clockid, &resolution))
+        return NULL;
+
+    if (CLOCK_MONOTONIC != clockid
+#ifdef CLOCK_BOOTTIME
+            && CLOCK_BOOTTIME != clockid
+#endif
+            ) {
+        PyErr_SetString(PyExc_ValueError,
+                "clockid must be CLOCK_MONOTONIC or CLOCK_BOOTTIME");
+        return NULL;
+    }
+
+    if (resolution < 1E-9) {
+        PyErr_SetString(PyExc_ValueError, "resolution must be at least 1ns");
+        return NULL;
+    }
+
+    if (!(self = (python_timerwheel_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->fd = -1;
+    self->clockid = clockid;
+    self->resolution = (uint64_t)(resolution * 1E9 + 0.5);
+    self->current = 0;
+    self->armed = WHEEL_NEVER;
+    self->timers = NULL;
+    self->capacity = self->live = 0;
+    self->free = WHEEL_NIL;
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        memset(self->slots[level], 0xff, sizeof(self->slots[level]));
+        memset(self->occupied[level], 0, sizeof(self->occupied[level]));
+    }
+
+    if (wheel_now(self, &self->base)) {
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    if ((self->fd = timerfd_create(clockid, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+static void
+python_timerwheel_dealloc(python_timerwheel_object *self) {
+    uint32_t i;
+
+    for (i = 0; i < self->capacity; ++i)
+        if (self->timers[i].level >= 0)
+            Py_XDECREF(self->timers[i].token);
+    free(self->timers);
+
+    if (self->fd >= 0)
+        close(self->fd);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+python_timerwheel_length(python_timerwheel_object *self) {
+    return (Py_ssize_t)self->live;
+}
+
+static int
+timerwheel_check(python_timerwheel_object *self) {
+    if (self->fd < 0) {
+        PyErr_SetString(PyExc_ValueError, "TimerWheel is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+python_timerwheel_add(python_timerwheel_object *self, PyObject *args) {
+    double timeout;
+    PyObject *token;
+    uint64_t now;
+    int32_t index;
+
+    if (!PyArg_ParseTuple(args, "dO", &timeout, &token))
+        return NULL;
+
+    if (timerwheel_check(self) || wheel_now(self, &now))
+        return NULL;
+
+    /* an empty wheel may have fallen behind the clock, catch it up for free */
+    if (!self->live && self->current < (now - self->base) / self->resolution)
+        self->current = (now - self->base) / self->resolution;
+
+    if (WHEEL_NIL == (index = wheel_alloc(self)))
+        return NULL;
+
+    Py_INCREF(token);
+    self->timers[index].token = token;
+    self->timers[index].expires = wheel_ticks(self, timeout, now);
+    wheel_link(self, index);
+
+    if (self->timers[index].expires < self->armed && wheel_arm(self)) {
+        wheel_unlink(self, index);
+        Py_DECREF(token);
+        wheel_release(self, index);
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(
+            ((unsigned PY_LONG_LONG)self->timers[index].gen << 32) | index);
+}
+
+static PyObject *
+python_timerwheel_cancel(python_timerwheel_object *self, PyObject *pyid) {
+    unsigned PY_LONG_LONG id;
+    int32_t index;
+
+    id = PyLong_AsUnsignedLongLong(pyid);
+    if (PyErr_Occurred())
+        return NULL;
+
+    if (WHEEL_NIL == (index = wheel_lookup(self, id))) {
+        Py_INCREF(Py_False);
+        return Py_False;
+    }
+
+    /* the timerfd is left armed; an early wakeup just finds nothing due */
+    wheel_unlink(self, index);
+    Py_DECREF(self->timers[index].token);
+    wheel_release(self, index);
+
+    Py_INCREF(Py_True);
+    return Py_True;
+}
+
+static PyObject *
+python_timerwheel_reschedule(python_timerwheel_object *self, PyObject *args) {
+    unsigned PY_LONG_LONG id;
+    double timeout;
+    uint64_t now;
+    int32_t index;
+
+    if (!PyArg_ParseTuple(args, "Kd", &id, &timeout))
+        return NULL;
+
+    if (timerwheel_check(self) || wheel_now(self, &now))
+        return NULL;
+
+    if (WHEEL_NIL == (index = wheel_lookup(self, id))) {
+        PyErr_SetString(PyExc_KeyError, "no such timer");
+        return NULL;
+    }
+
+    wheel_unlink(self, index);
+    self->timers[index].expires = wheel_ticks(self, timeout, now);
+    wheel_link(self, index);
+
+    if (self->timers[index].expires < self->armed && wheel_arm(self))
+        return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_timerwheel_expired(python_timerwheel_object *self, PyObject *iamnull) {
+    uint64_t expirations, now;
+    PyObject *result;
+
+    if (timerwheel_check(self))
+        return NULL;
+
+    /* clear the timerfd's readiness; it's nonblocking so this can't stall */
+    if (read(self->fd, &expirations, sizeof(expirations)) < 0 &&
+            EAGAIN != errno) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->armed = WHEEL_NEVER;
+
+    if (wheel_now(self, &now))
+        return NULL;
+
+    if (NULL == (result = PyList_New(0)))
+        return NULL;
+
+    if (wheel_advance(self, (now - self->base) / self->resolution, result) ||
+            wheel_arm(self)) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+static PyObject *
+python_timerwheel_fileno(python_timerwheel_object *self, PyObject *iamnull) {
+    return PyInt_FromLong((long)self->fd);
+}
+
+static PyObject *
+python_timerwheel_close(python_timerwheel_object *self, PyObject *iamnull) {
+    if (self->fd >= 0 && close(self->fd) < 0) {
+        self->fd = -1;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->fd = -1;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyMethodDef timerwheel_methods[] = {
+    {"add", (PyCFunction)python_timerwheel_add, METH_VARARGS,
+        "schedule a new timer\n\
+\n\
+:param float timeout: seconds from now until the timer is due\n\
+\n\
+:param token: any object, handed back by :meth:`expired` once it's due\n\
+\n\
+:returns: an integer id for the timer\n\
+"},
+    {"cancel", (PyCFunction)python_timerwheel_cancel, METH_O,
+        "cancel a pending timer\n\
+\n\
+:param int id: the timer's id, as returned by :meth:`add`\n\
+\n\
+:returns:\n\
+    True if the timer was cancelled, False if it had already expired or been\n\
+    cancelled\n\
+"},
+    {"reschedule", (PyCFunction)python_timerwheel_reschedule, METH_VARARGS,
+        "move a pending timer to a new deadline\n\
+\n\
+:param int id: the timer's id, as returned by :meth:`add`\n\
+\n\
+:param float timeout: seconds from now until the timer is due\n\
+\n\
+:raises KeyError: if the timer has already expired or been cancelled\n\
+"},
+    {"expired", (PyCFunction)python_timerwheel_expired, METH_NOARGS,
+        "collect every timer that has come due\n\
+\n\
+call this when the wheel's file descriptor is readable. it never blocks.\n\
+\n\
+:returns:\n\
+    a list of the tokens of the expired timers, ordered by deadline only to\n\
+    the wheel's resolution\n\
+"},
+    {"fileno", (PyCFunction)python_timerwheel_fileno, METH_NOARGS,
+        "get the file descriptor of the underlying timerfd\n\
+\n\
+:returns: integer file descriptor, for use with select/poll/epoll\n\
+"},
+    {"close", (PyCFunction)python_timerwheel_close, METH_NOARGS,
+        "close the underlying timerfd\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods timerwheel_as_sequence = {
+    (lenfunc)python_timerwheel_length,         /* sq_length */
+};
+
+static PyTypeObject python_timerwheel_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.fds.TimerWheel",                  /* tp_name */
+    sizeof(python_timerwheel_object),          /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_timerwheel_dealloc,     /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &timerwheel_as_sequence,                   /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "TimerWheel(clockid=CLOCK_MONOTONIC, resolution=0.001)\n\
+\n\
+any number of timers sharing a single timerfd\n\
+\n\
+adding, cancelling and rescheduling timers are constant time and only make\n\
+a system call when the new deadline is the earliest. ``clockid`` may be\n\
+``CLOCK_MONOTONIC`` or ``CLOCK_BOOTTIME``, and deadlines are rounded up to\n\
+a multiple of ``resolution`` seconds. the length of a TimerWheel is the\n\
+number of pending timers.",                    /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    timerwheel_methods,                        /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_timerwheel_new,                     /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+#endif /* TIMERFD_MISSING */
+
+
+#ifndef SIGNALFD_MISSING
+/*
+ * signalfd
+ */
+
+static int
+wrap_sigset(sigset_t *set, PyObject *signals) {
+    int signum;
+    PyObject *iter, *item, *pysignum;
+
+    if (NULL == (iter = PyObject_GetIter(signals)))
+        return -1;
+
+    while ((item = PyIter_Next(iter))) {
+        if (NULL == (pysignum = PyNumber_Int(item))) {
+            Py_DECREF(iter);
+            Py_DECREF(item);
+            return -1;
+        }
+
+        if (-1 == (signum = PyInt_AsLong(pysignum)) && PyErr_Occurred()) {
+            Py_DECREF(iter);
+            Py_DECREF(item);
+            Py_DECREF(pysignum);
+            return -1;
+        }
+
+        if (sigaddset(set, signum) < 0) {
+            Py_DECREF(iter);
+            Py_DECREF(item);
+            Py_DECREF(pysignum);
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+
+        Py_DECREF(item);
+        Py_DECREF(pysignum);
+    }
+    Py_DECREF(iter);
+
+    return 0;
+}
+
+static PyObject *
+unwrap_siginfo(struct signalfd_siginfo *info) {
+    return new_struct_seq(&siginfo_type, 2,
+            PyInt_FromLong((long)info->ssi_signo),
+            PyInt_FromLong((long)info->ssi_code));
+}
+
+static PyObject *
+python_signalfd(PyObject *module, PyObject *args) {
+    int fd, flags = 0;
+    sigset_t mask;
+    PyObject *signals, *result;
+
+    sigemptyset(&mask);
+
+    if (!PyArg_ParseTuple(args, "iO|i", &fd, &signals, &flags))
+        return NULL;
+
+    if (wrap_sigset(&mask, signals))
+        return NULL;
+
+    if ((fd = signalfd(fd, &mask, flags)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (NULL == (result = PyInt_FromLong((long)fd)))
+        return NULL;
+
+    return result;
+}
+
+static PyObject *
+python_read_signalfd(PyObject *module, PyObject *args) {
+    int fd;
+    struct signalfd_siginfo info;
+    ssize_t length;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, (void *)&info, sizeof(struct signalfd_siginfo));
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    return unwrap_siginfo(&info);
+}
+
+static PyObject *
+unwrap_signalfd_siginfo(struct signalfd_siginfo *info) {
+    return new_struct_seq(&signalfd_siginfo_type, 16,
+            PyLong_FromUnsignedLong(info->ssi_signo),
+            PyInt_FromLong((long)info->ssi_errno),
+            PyInt_FromLong((long)info->ssi_code),
+            PyLong_FromUnsignedLong(info->ssi_pid),
+            PyLong_FromUnsignedLong(info->ssi_uid),
+            PyInt_FromLong((long)info->ssi_fd),
+            PyLong_FromUnsignedLong(info->ssi_tid),
+            PyLong_FromUnsignedLong(info->ssi_band),
+            PyLong_FromUnsignedLong(info->ssi_overrun),
+            PyLong_FromUnsignedLong(info->ssi_trapno),
+            PyInt_FromLong((long)info->ssi_status),
+            PyInt_FromLong((long)info->ssi_int),
+            PyLong_FromUnsignedLongLong(info->ssi_ptr),
+            PyLong_FromUnsignedLongLong(info->ssi_utime),
+            PyLong_FromUnsignedLongLong(info->ssi_stime),
+            PyLong_FromUnsignedLongLong(info->ssi_addr));
+}
+
+static char *read_signalfd_many_kwargs[] = {"fd", "max", NULL};
+
+static PyObject *
+python_read_signalfd_many(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int fd, max = 64, i, count;
+    struct signalfd_siginfo *infos;
+    ssize_t length;
+    PyObject *result, *item;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|i",
+                read_signalfd_many_kwargs, &fd, &max))
+        return NULL;
+
+    if (max <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max must be positive");
+        return NULL;
+    }
+
+    if (!(infos = malloc(sizeof(struct signalfd_siginfo) * max)))
+        return PyErr_NoMemory();
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, (void *)infos, sizeof(struct signalfd_siginfo) * max);
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        free(infos);
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    count = (int)(length / sizeof(struct signalfd_siginfo));
+    if (NULL == (result = PyList_New(count))) {
+        free(infos);
+        return NULL;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (NULL == (item = unwrap_signalfd_siginfo(&infos[i]))) {
+            free(infos);
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    free(infos);
+    return result;
+}
+#endif /* SIGNALFD_MISSING */
+
+
+/*
+ * inotify
+ */
+
+# ifndef INOTIFY_MISSING
+
+static char *inotify_init_kwargs[] = {"flags", NULL};
+
+static PyObject *
+python_inotify_init(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int result, flags = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", inotify_init_kwargs,
+                &flags))
+        return NULL;
+
+    if ((result = inotify_init1(flags)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)result);
+}
+
+static PyObject *
+python_inotify_add_watch(PyObject *module, PyObject *args) {
+    int result, fd, mask;
+    char *pathname;
+
+    if (!PyArg_ParseTuple(args, "isi", &fd, &pathname, &mask))
+        return NULL;
+
+    if ((result = inotify_add_watch(fd, pathname, (uint32_t)mask)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)result);
+}
+
+static PyObject *
+build_inotify_event(int wd, uint32_t mask, uint32_t cookie, const char *name) {
+    return new_struct_seq(&inotify_event_type, 4,
+            PyInt_FromLong((long)wd),
+            PyInt_FromLong((long)mask),
+            PyInt_FromLong((long)cookie),
+            string_or_none(name));
+}
+
+static PyObject *
+wrap_inotify_event(struct inotify_event *in_evp) {
+    return build_inotify_event(in_evp->wd, in_evp->mask, in_evp->cookie,
+            in_evp->len ? &in_evp->name[0] : NULL);
+}
+
+static PyObject *
+python_read_inotify_event(PyObject *module, PyObject *args) {
+    int fd;
+    ssize_t length;
+    size_t size = sizeof(struct inotify_event) + NAME_MAX + 1;
+    char buf[size], *p = &buf[0];
+    struct inotify_event *in_evp = (struct inotify_event *)&buf[0];
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, p, size);
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return wrap_inotify_event(in_evp);
+}
+
+/* read buffer kept between read_inotify_events calls. guarded by the GIL,
+   a call that finds it already in use by another thread mallocs its own */
+static char *inotify_buf = NULL;
+static size_t inotify_bufsize = 0;
+static char inotify_buf_busy = 0;
+
+static char *
+take_inotify_buf(size_t size) {
+    char *buf;
+
+    if (inotify_buf_busy)
+        return malloc(size);
+
+    if (size > inotify_bufsize) {
+        if (!(buf = realloc(inotify_buf, size)))
+            return NULL;
+        inotify_buf = buf;
+        inotify_bufsize = size;
+    }
+    inotify_buf_busy = 1;
+    return inotify_buf;
+}
+
+static void
+give_inotify_buf(char *buf) {
+    if (buf == inotify_buf)
+        inotify_buf_busy = 0;
+    else
+        free(buf);
+}
+
+/* wrap every event packed into buf[0:length] and append them to list */
+static int
+wrap_inotify_events(char *buf, ssize_t length, PyObject *list) {
+    struct inotify_event *in_evp;
+    PyObject *pyev;
+    char *p;
+
+    for (p = buf; p < buf + length;
+            p += sizeof(struct inotify_event) + in_evp->len) {
+        in_evp = (struct inotify_event *)p;
+        if (NULL == (pyev = wrap_inotify_event(in_evp)))
+            return -1;
+        if (PyList_Append(list, pyev)) {
+            Py_DECREF(pyev);
+            return -1;
+        }
+        Py_DECREF(pyev);
+    }
+
+    return 0;
+}
+
+static char *read_inotify_events_kwargs[] = {"fd", "bufsize", NULL};
+
+static PyObject *
+python_read_inotify_events(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int fd;
+    ssize_t length;
+    Py_ssize_t size = 65536;
+    char *buf;
+    PyObject *result;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|n",
+                read_inotify_events_kwargs, &fd, &size))
+        return NULL;
+
+    if (size < (Py_ssize_t)(sizeof(struct inotify_event) + NAME_MAX + 1)) {
+        PyErr_SetString(PyExc_ValueError,
+                "bufsize too small to hold an inotify event");
+        return NULL;
+    }
+
+    if (NULL == (buf = take_inotify_buf((size_t)size)))
+        return PyErr_NoMemory();
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, buf, (size_t)size);
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        give_inotify_buf(buf);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (NULL == (result = PyList_New(0)) ||
+            wrap_inotify_events(buf, length, result)) {
+        give_inotify_buf(buf);
+        Py_XDECREF(result);
+        return NULL;
+    }
+
+    give_inotify_buf(buf);
+    return result;
+}
+
+/*
+ * coalescing reads
+ *
+ * raw events are merged before any python objects are built: repeats of the
+ * same (wd, name) have their masks ORed into the first occurrence, and
+ * IN_MOVED_FROM/IN_MOVED_TO pairs sharing a cookie become single renames.
+ */
+
+typedef struct {
+    int wd;
+    uint32_t mask;
+    uint32_t cookie;
+    const char *name;
+    int to_wd;
+    const char *to_name;
+    char renamed;
+} coalesced_event;
+
+
+static size_t
+event_key_hash(int wd, const char *name) {
+    size_t h = 2166136261u ^ (size_t)wd;
+
+    h *= 16777619u;
+    if (NULL != name) {
+        for (; *name; ++name) {
+            h ^= (unsigned char)*name;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+static int
+same_name(const char *a, const char *b) {
+    if (NULL == a || NULL == b) return a == b;
+    return !strcmp(a, b);
+}
+
+/* returns the number of coalesced events written to out */
+static Py_ssize_t
+coalesce_inotify_events(char *buf, ssize_t length, coalesced_event *out,
+        Py_ssize_t *keys, Py_ssize_t *moves, size_t tablesize) {
+    struct inotify_event *in_evp;
+    coalesced_event *rec;
+    Py_ssize_t count = 0, idx;
+    size_t i, mask = tablesize - 1;
+    const char *name;
+    char *p;
+
+    for (i = 0; i < tablesize; ++i)
+        keys[i] = moves[i] = -1;
+
+    for (p = buf; p < buf + length;
+            p += sizeof(struct inotify_event) + in_evp->len) {
+        in_evp = (struct inotify_event *)p;
+        name = in_evp->len ? in_evp->name : NULL;
+
+        if (in_evp->mask & IN_MOVED_TO && in_evp->cookie) {
+            for (i = in_evp->cookie & mask; moves[i] >= 0;
+                    i = (i + 1) & mask) {
+                rec = &out[moves[i]];
+                if (rec->cookie == in_evp->cookie && !rec->renamed) break;
+            }
+            if (moves[i] >= 0) {
+                rec->renamed = 1;
+                rec->mask |= in_evp->mask;
+                rec->to_wd = in_evp->wd;
+                rec->to_name = name;
+                continue;
+            }
+        }
+
+        if (in_evp->mask & IN_MOVED_FROM && in_evp->cookie) {
+            for (i = in_evp->cookie & mask; moves[i] >= 0; i = (i + 1) & mask);
+            moves[i] = count;
+        } else if (!in_evp->cookie &&
+                !(in_evp->mask & (IN_Q_OVERFLOW | IN_IGNORED))) {
+            for (i = event_key_hash(in_evp->wd, name) & mask;
+                    (idx = keys[i]) >= 0; i = (i + 1) & mask) {
+                if (out[idx].wd == in_evp->wd && same_name(out[idx].name, name))
+                    break;
+            }
+            if (idx >= 0) {
+                out[idx].mask |= in_evp->mask;
+                continue;
+            }
+            keys[i] = count;
+        }
+
+        rec = &out[count++];
+        rec->wd = in_evp->wd;
+        rec->mask = in_evp->mask;
+        rec->cookie = in_evp->cookie;
+        rec->name = name;
+        rec->to_wd = -1;
+        rec->to_name = NULL;
+        rec->renamed = 0;
+    }
+
+    return count;
+}
+
+static PyObject *
+wrap_inotify_rename(coalesced_event *rec) {
+    return new_struct_seq(&inotify_rename_type, 6,
+            PyInt_FromLong((long)rec->wd),
+            string_or_none(rec->name),
+            PyInt_FromLong((long)rec->to_wd),
+            string_or_none(rec->to_name),
+            PyLong_FromUnsignedLong(rec->mask),
+            PyLong_FromUnsignedLong(rec->cookie));
+}
+
+static char *read_inotify_events_coalesced_kwargs[] = {
+    "fd", "window", "bufsize", NULL};
+
+static PyObject *
+python_read_inotify_events_coalesced(PyObject *module, PyObject *args,
+        PyObject *kwargs) {
+    int fd, rc, timeout_ms;
+    double window = 0;
+    ssize_t length, more;
+    Py_ssize_t i, count, size = 65536, minsize;
+    size_t tablesize;
+    char *buf;
+    struct pollfd pfd;
+    struct timespec now, deadline;
+    coalesced_event *events = NULL;
+    Py_ssize_t *tables = NULL;
+    PyObject *result = NULL, *item;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|dn",
+                read_inotify_events_coalesced_kwargs, &fd, &window, &size))
+        return NULL;
+
+    minsize = (Py_ssize_t)(sizeof(struct inotify_event) + NAME_MAX + 1);
+    if (size < minsize) {
+        PyErr_SetString(PyExc_ValueError,
+                "bufsize too small to hold an inotify event");
+        return NULL;
+    }
+
+    if (NULL == (buf = take_inotify_buf((size_t)size)))
+        return PyErr_NoMemory();
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(fd, buf, (size_t)size);
+
+    /* keep collecting until the window closes or the buffer is full */
+    if (length > 0 && window > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (time_t)window;
+        deadline.tv_nsec += (long)((window - (long)window) * 1E9);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (size - length >= minsize) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timeout_ms = (int)((deadline.tv_sec - now.tv_sec) * 1000 +
+                    (deadline.tv_nsec - now.tv_nsec + 999999) / 1000000);
+            if (timeout_ms <= 0) break;
+
+            if ((rc = poll(&pfd, 1, timeout_ms)) <= 0) break;
+            if ((more = read(fd, buf + length, (size_t)(size - length))) <= 0)
+                break;
+            length += more;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        give_inotify_buf(buf);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    count = length / sizeof(struct inotify_event) + 1;
+    for (tablesize = 16; tablesize < 2 * (size_t)count; tablesize <<= 1);
+
+    if (!(events = malloc(count * sizeof(coalesced_event))) ||
+            !(tables = malloc(2 * tablesize * sizeof(Py_ssize_t)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    count = coalesce_inotify_events(buf, length, events, tables,
+            tables + tablesize, tablesize);
+
+    if (NULL == (result = PyList_New(count)))
+        goto done;
+
+    for (i = 0; i < count; ++i) {
+        if (events[i].renamed)
+            item = wrap_inotify_rename(&events[i]);
+        else
+            item = build_inotify_event(events[i].wd, events[i].mask,
+                    events[i].cookie, events[i].name);
+        if (NULL == item) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+done:
+    free(events);
+    free(tables);
+    give_inotify_buf(buf);
+    return result;
+}
+
+static PyObject *
+python_inotify_rm_watch(PyObject *module, PyObject *args) {
+    int fd, wd;
+
+    if (!PyArg_ParseTuple(args, "ii", &fd, &wd))
+        return NULL;
+
+    if (inotify_rm_watch(fd, wd) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/*
+ * recursive directory watcher
+ *
+ * TreeWatcher owns an inotify instance with a watch on every directory under
+ * a root, and an open-addressed hash table mapping each watch descriptor to
+ * its directory's path. new subdirectories are watched (and scanned, so
+ * anything created in them before the watch landed is still reported) as
+ * their IN_CREATE/IN_MOVED_TO events are read, and a directory renamed within
+ * the tree has all of the paths under it rewritten in one pass.
+ */
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+#define WATCH_EMPTY    0
+#define WATCH_DELETED -1
+
+#define TREE_WATCH_MASK (IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO | \
+        IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+typedef struct {
+    int wd;
+    char *path;
+} watch_entry;
+
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    uint32_t mask;
+    watch_entry *table;
+    size_t size; /* always a power of 2 */
+    size_t used; /* live entries plus tombstones */
+    size_t live;
+    uint32_t move_cookie;
+    char *move_from;
+} python_treewatcher_object;
+
+
+static watch_entry *
+watch_lookup(python_treewatcher_object *self, int wd) {
+    size_t i, mask = self->size - 1;
+
+    for (i = ((size_t)wd * 2654435761u) & mask;
+            WATCH_EMPTY != self->table[i].wd; i = (i + 1) & mask) {
+        if (wd == self->table[i].wd) return &self->table[i];
+    }
+    return NULL;
+}
+
+static int
+watch_resize(python_treewatcher_object *self, size_t size) {
+    watch_entry *old = self->table;
+    size_t i, j, oldsize = self->size;
+
+    if (!(self->table = calloc(size, sizeof(watch_entry)))) {
+        self->table = old;
+        return -1;
+    }
+    self->size = size;
+    self->used = self->live;
+
+    for (i = 0; i < oldsize; ++i) {
+        if (old[i].wd <= 0) continue;
+        for (j = ((size_t)old[i].wd * 2654435761u) & (size - 1);
+                WATCH_EMPTY != self->table[j].wd; j = (j + 1) & (size - 1));
+        self->table[j] = old[i];
+    }
+
+    free(old);
+    return 0;
+}
+
+/* takes ownership of path */
+static int
+watch_insert(python_treewatcher_object *self, int wd, char *path) {
+    watch_entry *entry;
+    size_t i, mask;
+
+    if (NULL != (entry = watch_lookup(self, wd))) {
+        free(entry->path);
+        entry->path = path;
+        return 0;
+    }
+
+    if (2 * (self->used + 1) > self->size &&
+            watch_resize(self, 2 * (self->live + 1) > self->size / 2 ?
+                self->size * 2 : self->size)) {
+        free(path);
+        return -1;
+    }
+
+    mask = self->size - 1;
+    for (i = ((size_t)wd * 2654435761u) & mask; self->table[i].wd > 0;
+            i = (i + 1) & mask);
+    if (WATCH_EMPTY == self->table[i].wd) ++self->used;
+    ++self->live;
+    self->table[i].wd = wd;
+    self->table[i].path = path;
+    return 0;
+}
+
+static void
+watch_remove(python_treewatcher_object *self, watch_entry *entry) {
+    free(entry->path);
+    entry->path = NULL;
+    entry->wd = WATCH_DELETED;
+    --self->live;
+}
+
+static char *
+join_path(const char *dir, const char *name) {
+    size_t dirlen = strlen(dir), namelen = strlen(name);
+    char *path;
+
+    if (!(path = malloc(dirlen + namelen + 2)))
+        return NULL;
+    memcpy(path, dir, dirlen);
+    path[dirlen] = '/';
+    memcpy(path + dirlen + 1, name, namelen + 1);
+    return path;
+}
+
+static int
+append_tree_event(PyObject *list, const char *path, uint32_t mask,
+        uint32_t cookie) {
+    PyObject *pyev;
+    int rc;
+
+    if (NULL == (pyev = new_struct_seq(&tree_event_type, 3,
+                    string_or_none(path),
+                    PyLong_FromUnsignedLong(mask),
+                    PyLong_FromUnsignedLong(cookie))))
+        return -1;
+
+    rc = PyList_Append(list, pyev);
+    Py_DECREF(pyev);
+    return rc;
+}
+
+/*
+ * watch root and every directory below it, scanning with getdents64(2).
+ * with a non-NULL events list and IN_CREATE in the mask, everything found
+ * below root is reported in it as an IN_CREATE. failing to watch anything
+ * but the root of the initial scan is ignored unless the system is out of
+ * watches or memory.
+ *
+ * without an events list this touches no python objects and runs without
+ * the GIL, so it leaves errno and, if it was a watch that failed, a copy of
+ * the path in *errpath. returns -1 for that, or -2 with an exception set.
+ */
+static int
+scan_tree(python_treewatcher_object *self, const char *root,
+        PyObject *events, char **errpath) {
+    char **stack = NULL, **grown, *path = NULL, *child;
+    char buf[32768];
+    size_t depth = 0, stacksize = 0;
+    struct linux_dirent64 *dent;
+    struct stat st;
+    long nread, pos;
+    int wd, dirfd, isdir, err, rc = -1;
+
+    if (!(path = strdup(root)))
+        goto nomem;
+    wd = inotify_add_watch(self->fd, path, self->mask | TREE_WATCH_MASK);
+    if (wd < 0) {
+        /* a new directory may already be gone again */
+        if (NULL != events && ENOSPC != errno && ENOMEM != errno) {
+            free(path);
+            return 0;
+        }
+        *errpath = path;
+        return -1;
+    }
+
+    for (;;) {
+        if ((dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+            while ((nread = syscall(SYS_getdents64, dirfd, buf,
+                            sizeof(buf))) > 0) {
+                for (pos = 0; pos < nread; pos += dent->d_reclen) {
+                    dent = (struct linux_dirent64 *)(buf + pos);
+                    if ('.' == dent->d_name[0] && (!dent->d_name[1] ||
+                            ('.' == dent->d_name[1] && !dent->d_name[2])))
+                        continue;
+
+                    if (DT_UNKNOWN == dent->d_type)
+                        isdir = !fstatat(dirfd, dent->d_name, &st,
+                                AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode);
+                    else
+                        isdir = DT_DIR == dent->d_type;
+
+                    if (!(child = join_path(path, dent->d_name)))
+                        goto nomem_in_dir;
+
+                    if (NULL != events && self->mask & IN_CREATE &&
+                            append_tree_event(events, child,
+                                IN_CREATE | (isdir ? IN_ISDIR : 0), 0)) {
+                        free(child);
+                        close(dirfd);
+                        rc = -2;
+                        goto fail;
+                    }
+
+                    if (!isdir) {
+                        free(child);
+                        continue;
+                    }
+
+                    if (depth == stacksize) {
+                        stacksize = stacksize ? stacksize * 2 : 64;
+                        if (!(grown = realloc(stack,
+                                        stacksize * sizeof(char *)))) {
+                            free(child);
+                            goto nomem_in_dir;
+                        }
+                        stack = grown;
+                    }
+                    stack[depth++] = child;
+                }
+            }
+            close(dirfd);
+        }
+
+        if (watch_insert(self, wd, path)) {
+            path = NULL;
+            goto nomem;
+        }
+        path = NULL;
+
+        /* find the next directory that can still be watched */
+        while (depth) {
+            path = stack[--depth];
+            wd = inotify_add_watch(self->fd, path,
+                    self->mask | TREE_WATCH_MASK);
+            if (wd >= 0) break;
+            if (ENOSPC == errno || ENOMEM == errno) {
+                *errpath = path;
+                path = NULL;
+                goto fail;
+            }
+            free(path);
+            path = NULL;
+        }
+        if (NULL == path) break;
+    }
+
+    free(stack);
+    return 0;
+
+nomem_in_dir:
+    close(dirfd);
+nomem:
+    errno = ENOMEM;
+fail:
+    err = errno;
+    free(path);
+    while (depth) free(stack[--depth]);
+    free(stack);
+    errno = err;
+    return rc;
+}
+
+static int
+watch_tree(python_treewatcher_object *self, const char *root,
+        PyObject *events) {
+    char *errpath = NULL;
+    int rc, err;
+
+    /* the initial scan can be a big tree, and self is no one else's yet */
+    if (NULL == events) {
+        Py_BEGIN_ALLOW_THREADS
+        rc = scan_tree(self, root, NULL, &errpath);
+        err = errno;
+        Py_END_ALLOW_THREADS
+    } else {
+        rc = scan_tree(self, root, events, &errpath);
+        err = errno;
+    }
+
+    if (-1 == rc) {
+        errno = err;
+        if (NULL != errpath)
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, errpath);
+        else
+            PyErr_NoMemory();
+    }
+    free(errpath);
+    return rc ? -1 : 0;
+}
+
+/* rewrite the paths of `from` and everything below it to be under `to` */
+static int
+watch_rename(python_treewatcher_object *self, const char *from,
+        const char *to) {
+    size_t i, fromlen = strlen(from), tolen = strlen(to), restlen;
+    char *path, *renamed;
+
+    for (i = 0; i < self->size; ++i) {
+        if (self->table[i].wd <= 0) continue;
+        path = self->table[i].path;
+        if (strncmp(path, from, fromlen) ||
+                (path[fromlen] && '/' != path[fromlen]))
+            continue;
+
+        restlen = strlen(path + fromlen);
+        if (!(renamed = malloc(tolen + restlen + 1)))
+            return -1;
+        memcpy(renamed, to, tolen);
+        memcpy(renamed + tolen, path + fromlen, restlen + 1);
+        free(path);
+        self->table[i].path = renamed;
+    }
+
+    return 0;
+}
+
+/* a directory was moved out of the tree, stop watching it and its children */
+static void
+settle_move(python_treewatcher_object *self) {
+    size_t i, fromlen;
+    char *path;
+
+    if (NULL == self->move_from) return;
+    fromlen = strlen(self->move_from);
+
+    for (i = 0; i < self->size; ++i) {
+        if (self->table[i].wd <= 0) continue;
+        path = self->table[i].path;
+        if (strncmp(path, self->move_from, fromlen) ||
+                (path[fromlen] && '/' != path[fromlen]))
+            continue;
+        inotify_rm_watch(self->fd, self->table[i].wd);
+        watch_remove(self, &self->table[i]);
+    }
+
+    free(self->move_from);
+    self->move_from = NULL;
+}
+
+static void
+python_treewatcher_dealloc(python_treewatcher_object *self) {
+    size_t i;
+
+    if (self->fd >= 0) close(self->fd);
+    for (i = 0; i < self->size; ++i) {
+        if (self->table[i].wd > 0) free(self->table[i].path);
+    }
+    free(self->table);
+    free(self->move_from);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static char *treewatcher_kwargs[] = {"path", "mask", "flags", NULL};
+
+static PyObject *
+python_treewatcher_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_treewatcher_object *self;
+    char *path;
+    unsigned int mask = IN_ALL_EVENTS;
+    int flags = 0;
+    size_t len;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|Ii", treewatcher_kwargs,
+                &path, &mask, &flags))
+        return NULL;
+
+    if (!(self = (python_treewatcher_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->fd = -1;
+    self->mask = mask;
+    self->move_from = NULL;
+    self->size = self->used = self->live = 0;
+    if (!(self->table = calloc(64, sizeof(watch_entry)))) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    self->size = 64;
+
+    if ((self->fd = inotify_init1(flags)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    /* keep paths free of trailing slashes so joins and prefixes line up */
+    for (len = strlen(path); len > 1 && '/' == path[len - 1]; --len);
+    path = strndup(path, len);
+
+    if (NULL == path) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+
+    if (watch_tree(self, path, NULL)) {
+        free(path);
+        Py_DECREF(self);
+        return NULL;
+    }
+    free(path);
+
+    return (PyObject *)self;
+}
+
+static Py_ssize_t
+python_treewatcher_length(python_treewatcher_object *self) {
+    return (Py_ssize_t)self->live;
+}
+
+static PyObject *
+python_treewatcher_fileno(python_treewatcher_object *self, PyObject *iamnull) {
+    return PyInt_FromLong((long)self->fd);
+}
+
+static PyObject *
+python_treewatcher_close(python_treewatcher_object *self, PyObject *iamnull) {
+    if (self->fd >= 0 && close(self->fd) < 0) {
+        self->fd = -1;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->fd = -1;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *treewatcher_read_kwargs[] = {"bufsize", NULL};
+
+static PyObject *
+python_treewatcher_read(python_treewatcher_object *self, PyObject *args,
+        PyObject *kwargs) {
+    Py_ssize_t size = 65536;
+    ssize_t length;
+    char *buf, *p, *path = NULL;
+    struct inotify_event *in_evp;
+    watch_entry *entry;
+    PyObject *result;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n",
+                treewatcher_read_kwargs, &size))
+        return NULL;
+
+    if (self->fd < 0) {
+        PyErr_SetString(PyExc_ValueError, "TreeWatcher is closed");
+        return NULL;
+    }
+
+    if (size < (Py_ssize_t)(sizeof(struct inotify_event) + NAME_MAX + 1)) {
+        PyErr_SetString(PyExc_ValueError,
+                "bufsize too small to hold an inotify event");
+        return NULL;
+    }
+
+    if (NULL == (buf = take_inotify_buf((size_t)size)))
+        return PyErr_NoMemory();
+
+    Py_BEGIN_ALLOW_THREADS
+    length = read(self->fd, buf, (size_t)size);
+    Py_END_ALLOW_THREADS
+
+    if (length < 0) {
+        give_inotify_buf(buf);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (NULL == (result = PyList_New(0))) {
+        give_inotify_buf(buf);
+        return NULL;
+    }
+
+    for (p = buf; p < buf + length;
+            p += sizeof(struct inotify_event) + in_evp->len) {
+        in_evp = (struct inotify_event *)p;
+
+        /* the kernel queues a rename's two halves back to back, so anything
+         * else after a directory's IN_MOVED_FROM means it left the tree */
+        if (NULL != self->move_from && !(in_evp->mask & IN_MOVED_TO &&
+                    in_evp->cookie == self->move_cookie))
+            settle_move(self);
+
+        if (in_evp->mask & IN_Q_OVERFLOW) {
+            if (append_tree_event(result, NULL, in_evp->mask, 0))
+                goto fail;
+            continue;
+        }
+
+        if (NULL == (entry = watch_lookup(self, in_evp->wd)))
+            continue;
+
+        if (in_evp->mask & IN_IGNORED) {
+            watch_remove(self, entry);
+            continue;
+        }
+
+        path = in_evp->len ? join_path(entry->path, in_evp->name)
+            : strdup(entry->path);
+        if (NULL == path) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+
+        if (in_evp->mask & self->mask &&
+                append_tree_event(result, path, in_evp->mask, in_evp->cookie))
+            goto fail;
+
+        if (in_evp->mask & IN_ISDIR) {
+            if (in_evp->mask & IN_MOVED_FROM) {
+                settle_move(self);
+                self->move_from = path;
+                self->move_cookie = in_evp->cookie;
+                path = NULL;
+            } else if (in_evp->mask & IN_MOVED_TO && NULL != self->move_from
+                    && in_evp->cookie == self->move_cookie) {
+                if (watch_rename(self, self->move_from, path)) {
+                    PyErr_NoMemory();
+                    goto fail;
+                }
+                free(self->move_from);
+                self->move_from = NULL;
+            } else if (in_evp->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (watch_tree(self, path, result))
+                    goto fail;
+            }
+        }
 
-    if ((fd = signalfd(fd, &mask, flags)) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
-        return NULL;
+        free(path);
+        path = NULL;
     }
 
-    if (NULL == (result = PyInt_FromLong((long)fd)))
-        return NULL;
-
+    /* a trailing IN_MOVED_FROM may have its IN_MOVED_TO in the next read */
+    give_inotify_buf(buf);
     return result;
-}
 
-static PyObject *
-python_read_signalfd(PyObject *module, PyObject *args) {
-    int fd;
-    struct signalfd_siginfo info;
-    ssize_t length;
+fail:
+    free(path);
+    give_inotify_buf(buf);
+    Py_DECREF(result);
+    return NULL;
+}
 
-    if (!PyArg_ParseTuple(args, "i", &fd))
-        return NULL;
+static PyMethodDef treewatcher_methods[] = {
+    {"fileno", (PyCFunction)python_treewatcher_fileno, METH_NOARGS,
+        "get the file descriptor of the underlying inotify instance\n\
+\n\
+:returns: integer file descriptor, for use with select/poll/epoll\n\
+"},
+    {"read", (PyCFunction)python_treewatcher_read,
+        METH_VARARGS | METH_KEYWORDS,
+        "read the queued events for the whole tree\n\
+\n\
+watches are added for any new directories reported while doing so, and\n\
+their contents are scanned and, if the mask includes it, reported as\n\
+``IN_CREATE`` events. since the scan races with the kernel, a file created\n\
+in a brand new directory may be reported twice.\n\
+\n\
+:param int bufsize:\n\
+    the maximum number of bytes of raw events to read (default 64K)\n\
+\n\
+:returns:\n\
+    a list of :class:`tree_event<penguin.structs.tree_event>`, including\n\
+    only events in the mask the TreeWatcher was created with. the path of\n\
+    an ``IN_Q_OVERFLOW`` event is ``None``.\n\
+"},
+    {"close", (PyCFunction)python_treewatcher_close, METH_NOARGS,
+        "close the underlying inotify instance, dropping all of its watches\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
 
-    Py_BEGIN_ALLOW_THREADS
-    length = read(fd, (void *)&info, sizeof(struct signalfd_siginfo));
-    Py_END_ALLOW_THREADS
+static PySequenceMethods treewatcher_as_sequence = {
+    (lenfunc)python_treewatcher_length,        /* sq_length */
+};
 
-    if (length < 0) {
-        PyErr_SetFromErrno(PyExc_IOError);
-        return NULL;
-    }
+static PyTypeObject python_treewatcher_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.fds.TreeWatcher",                 /* tp_name */
+    sizeof(python_treewatcher_object),         /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_treewatcher_dealloc,    /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &treewatcher_as_sequence,                  /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "TreeWatcher(path, mask=IN_ALL_EVENTS, flags=0)\n\
+\n\
+an inotify instance watching every directory under ``path``\n\
+\n\
+``mask`` selects the events to report, ``flags`` are passed to\n\
+:func:`inotify_init`. the length of a TreeWatcher is the number of\n\
+directories it is watching.",                  /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    treewatcher_methods,                       /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_treewatcher_new,                    /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
 
-    return unwrap_siginfo(&info);
-}
-#endif /* SIGNALFD_MISSING */
+#endif
 
 
 /*
- * inotify
+ * fanotify
  */
 
-# ifndef INOTIFY_MISSING
+#ifndef FANOTIFY_MISSING
 
-static char *inotify_init_kwargs[] = {"flags", NULL};
+
+static char *fanotify_init_kwargs[] = {"flags", "event_f_flags", NULL};
 
 static PyObject *
-python_inotify_init(PyObject *module, PyObject *args, PyObject *kwargs) {
-    int result, flags = 0;
+python_fanotify_init(PyObject *module, PyObject *args, PyObject *kwargs) {
+    unsigned int flags = 0, event_f_flags = O_RDONLY;
+    int fd;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", inotify_init_kwargs,
-                &flags))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|II", fanotify_init_kwargs,
+                &flags, &event_f_flags))
         return NULL;
 
-    if ((result = inotify_init1(flags)) < 0) {
+    if ((fd = fanotify_init(flags, event_f_flags)) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
-    return PyInt_FromLong((long)result);
+    return PyInt_FromLong((long)fd);
 }
 
-static PyObject *
-python_inotify_add_watch(PyObject *module, PyObject *args) {
-    int result, fd, mask;
-    char *pathname;
+static char *fanotify_mark_kwargs[] = {
+    "fd", "flags", "mask", "dirfd", "pathname", NULL};
 
-    if (!PyArg_ParseTuple(args, "isi", &fd, &pathname, &mask))
+static PyObject *
+python_fanotify_mark(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int fd, dirfd = AT_FDCWD;
+    unsigned int flags;
+    unsigned PY_LONG_LONG mask;
+    char *pathname = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iIK|iz",
+                fanotify_mark_kwargs, &fd, &flags, &mask, &dirfd, &pathname))
         return NULL;
 
-    if ((result = inotify_add_watch(fd, pathname, (uint32_t)mask)) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    if (fanotify_mark(fd, flags, (uint64_t)mask, dirfd, pathname) < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, pathname);
         return NULL;
     }
 
-    return PyInt_FromLong((long)result);
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
 static PyObject *
-wrap_inotify_event(struct inotify_event *in_evp) {
-    PyObject *obj, *args, *pyev;
-    if (NULL == (args = PyTuple_New(4))) return NULL;
-
-    if (NULL == (obj = PyInt_FromLong((long)in_evp->wd)))
-        goto fail;
-    PyTuple_SET_ITEM(args, 0, obj);
-
-    if (NULL == (obj = PyInt_FromLong((long)in_evp->mask)))
-        goto fail;
-    PyTuple_SET_ITEM(args, 1, obj);
-
-    if (NULL == (obj = PyInt_FromLong((long)in_evp->cookie)))
-        goto fail;
-    PyTuple_SET_ITEM(args, 2, obj);
-
-    if (0 == in_evp->len) {
-        Py_INCREF(Py_None);
-        PyTuple_SET_ITEM(args, 3, Py_None);
-    } else {
-        if (NULL == (obj = PyString_FromString(&in_evp->name[0])))
-            goto fail;
-        PyTuple_SET_ITEM(args, 3, obj);
+wrap_fanotify_event(struct fanotify_event_metadata *md) {
+    PyObject *fsid = Py_None, *handle = Py_None, *name = Py_None;
+#ifdef FAN_EVENT_INFO_TYPE_FID
+    struct fanotify_event_info_header *hdr;
+    struct fanotify_event_info_fid *fid;
+    struct file_handle *fh;
+    char *info, *end;
+
+    /* only the first file id record is reported */
+    info = (char *)md + md->metadata_len;
+    end = (char *)md + md->event_len;
+    while (info + sizeof(*hdr) <= end && Py_None == handle) {
+        hdr = (struct fanotify_event_info_header *)info;
+        if (!hdr->len) break;
+
+        switch (hdr->info_type) {
+        case FAN_EVENT_INFO_TYPE_FID:
+        case FAN_EVENT_INFO_TYPE_DFID:
+        case FAN_EVENT_INFO_TYPE_DFID_NAME:
+            fid = (struct fanotify_event_info_fid *)hdr;
+            fh = (struct file_handle *)fid->handle;
+
+            if (NULL == (fsid = PyLong_FromUnsignedLongLong(
+                    ((unsigned PY_LONG_LONG)(uint32_t)fid->fsid.val[0] << 32) |
+                    (uint32_t)fid->fsid.val[1])))
+                goto fail;
+
+            if (NULL == (handle = PyString_FromStringAndSize((char *)fh,
+                            sizeof(struct file_handle) + fh->handle_bytes)))
+                goto fail;
+
+            if (FAN_EVENT_INFO_TYPE_DFID_NAME == hdr->info_type &&
+                    NULL == (name = PyString_FromString(
+                            (char *)fh->f_handle + fh->handle_bytes)))
+                goto fail;
+        }
+        info += hdr->len;
     }
+#endif
 
-    pyev = PyObject_Call(PyInotifyEvent, args, NULL);
-    Py_DECREF(args);
-    return pyev;
+    if (Py_None == fsid) Py_INCREF(Py_None);
+    if (Py_None == handle) Py_INCREF(Py_None);
+    if (Py_None == name) Py_INCREF(Py_None);
 
+    return new_struct_seq(&fanotify_event_type, 6,
+            PyLong_FromUnsignedLongLong((unsigned PY_LONG_LONG)md->mask),
+            PyInt_FromLong((long)md->fd),
+            PyInt_FromLong((long)md->pid),
+            fsid, handle, name);
+
+#ifdef FAN_EVENT_INFO_TYPE_FID
 fail:
-    Py_DECREF(args);
+    if (Py_None != fsid) Py_XDECREF(fsid);
+    if (Py_None != handle) Py_XDECREF(handle);
     return NULL;
+#endif
 }
 
+static char *read_fanotify_events_kwargs[] = {"fd", "bufsize", NULL};
+
 static PyObject *
-python_read_inotify_event(PyObject *module, PyObject *args) {
+python_read_fanotify_events(PyObject *module, PyObject *args,
+        PyObject *kwargs) {
     int fd;
     ssize_t length;
-    size_t size = sizeof(struct inotify_event) + NAME_MAX + 1;
-    char buf[size], *p = &buf[0];
-    struct inotify_event *in_evp = (struct inotify_event *)&buf[0];
+    Py_ssize_t size = 65536;
+    char *buf;
+    struct fanotify_event_metadata *md;
+    PyObject *result, *pyev;
 
-    if (!PyArg_ParseTuple(args, "i", &fd))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|n",
+                read_fanotify_events_kwargs, &fd, &size))
         return NULL;
 
+    if (size < (Py_ssize_t)FAN_EVENT_METADATA_LEN) {
+        PyErr_SetString(PyExc_ValueError,
+                "bufsize too small to hold a fanotify event");
+        return NULL;
+    }
+
+    if (!(buf = malloc((size_t)size)))
+        return PyErr_NoMemory();
+
     Py_BEGIN_ALLOW_THREADS
-    length = read(fd, p, size);
+    length = read(fd, buf, (size_t)size);
     Py_END_ALLOW_THREADS
 
     if (length < 0) {
+        free(buf);
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
-    return wrap_inotify_event(in_evp);
+    if (NULL == (result = PyList_New(0)))
+        goto fail;
+
+    for (md = (struct fanotify_event_metadata *)buf; FAN_EVENT_OK(md, length);
+            md = FAN_EVENT_NEXT(md, length)) {
+        if (FANOTIFY_METADATA_VERSION != md->vers) {
+            PyErr_SetString(PyExc_RuntimeError,
+                    "fanotify metadata version mismatch");
+            goto fail;
+        }
+
+        if (NULL == (pyev = wrap_fanotify_event(md)))
+            goto fail;
+        if (PyList_Append(result, pyev)) {
+            Py_DECREF(pyev);
+            goto fail;
+        }
+        Py_DECREF(pyev);
+    }
+
+    free(buf);
+    return result;
+
+fail:
+    /* the list is discarded, so don't leak the open files of any event */
+    for (md = (struct fanotify_event_metadata *)buf; FAN_EVENT_OK(md, length);
+            md = FAN_EVENT_NEXT(md, length)) {
+        if (md->fd >= 0) close(md->fd);
+    }
+    free(buf);
+    Py_XDECREF(result);
+    return NULL;
 }
 
 static PyObject *
-python_inotify_rm_watch(PyObject *module, PyObject *args) {
-    int fd, wd;
+python_fanotify_respond(PyObject *module, PyObject *args) {
+    int fd;
+    struct fanotify_response response;
 
-    if (!PyArg_ParseTuple(args, "ii", &fd, &wd))
+    if (!PyArg_ParseTuple(args, "iiI", &fd, &response.fd, &response.response))
         return NULL;
 
-    if (inotify_rm_watch(fd, wd) < 0) {
+    if (write(fd, &response, sizeof(response)) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
@@ -443,8 +2755,7 @@ python_inotify_rm_watch(PyObject *module, PyObject *args) {
     return Py_None;
 }
 
-#endif
-
+#endif /* FANOTIFY_MISSING */
 
 /*
  * module
@@ -534,6 +2845,49 @@ see `man eventfd` for exactly what this does\n\
 :returns:\n\
     a two-tuple with the timer stored in the fd (time remaining until the\n\
     trigger, interval after that)"},
+
+    {"timerfd_settime_ns", (PyCFunction)python_timerfd_settime_ns,
+        METH_VARARGS | METH_KEYWORDS,
+        "arm or disarm a timerfd, with times in integer nanoseconds\n\
+\n\
+:param int fd: the file descriptor to set a timer on\n\
+\n\
+:param int value:\n\
+    nanoseconds until the timer first triggers, or the clock reading at\n\
+    which it does if ``absolute`` (0 disarms the timer)\n\
+\n\
+:param int interval:\n\
+    nanoseconds between triggers after the first (default of 0 means only\n\
+    trigger once)\n\
+\n\
+:param bool absolute: if True, ``value`` is an absolute time (default False)\n\
+\n\
+:returns:\n\
+    a plain two-tuple of the fd's previous setting in nanoseconds (time\n\
+    remaining until the next trigger, interval after that)\n\
+"},
+
+    {"timerfd_gettime_ns", python_timerfd_gettime_ns, METH_VARARGS,
+        "return the setting of a timerfd in integer nanoseconds\n\
+\n\
+:param int fd: file descriptor to read the timer from\n\
+\n\
+:returns:\n\
+    a plain two-tuple (nanoseconds remaining until the next trigger,\n\
+    interval after that)\n\
+"},
+
+    {"read_timerfd", python_read_timerfd, METH_VARARGS,
+        "read the expiration count of a timerfd\n\
+\n\
+this blocks until the timer has fired unless the fd is nonblocking.\n\
+\n\
+:param int fd: the timerfd to read\n\
+\n\
+:returns:\n\
+    the number of times the timer has expired since it was last set or\n\
+    read. more than 1 for a periodic timer means ticks were missed.\n\
+"},
 #endif
 
 #ifndef SIGNALFD_MISSING
@@ -559,6 +2913,20 @@ see `man eventfd` for exactly what this does\n\
 \n\
 :returns:\n\
     a two-tuple representing the signal it received, (signum, reason_code)"},
+
+    {"read_signalfd_many", (PyCFunction)python_read_signalfd_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "read a batch of signals from a signalfd in a single read(2)\n\
+\n\
+:param int fd: file descriptor to read signals from\n\
+\n\
+:param int max: the maximum number of signals to read (default 64)\n\
+\n\
+:returns:\n\
+    a list of :class:`signalfd_siginfo<penguin.structs.signalfd_siginfo>`\n\
+    with every field the kernel reported, so that e.g. the pid and exit\n\
+    status of a ``SIGCHLD`` are available without a separate waitpid(2)\n\
+"},
 #endif
 
 #ifndef INOTIFY_MISSING
@@ -598,6 +2966,54 @@ see `man eventfd` for exactly what this does\n\
     the information from the event.\n\
 "},
 
+    {"read_inotify_events", (PyCFunction)python_read_inotify_events,
+        METH_VARARGS | METH_KEYWORDS,
+        "read every queued event struct from an inotify instance at once\n\
+\n\
+this does a single read(2) into a buffer that is reused across calls, and\n\
+unpacks all of the events the kernel placed in it.\n\
+\n\
+:param int fd: file descriptor of the inotify instance\n\
+\n\
+:param int bufsize:\n\
+    the maximum number of bytes of events to read (default 64K). this must be\n\
+    large enough for at least one event with a ``NAME_MAX`` length name.\n\
+\n\
+:returns:\n\
+    a list of :class:`inotify_event<penguin.structs.inotify_event>`\n\
+"},
+
+    {"read_inotify_events_coalesced",
+        (PyCFunction)python_read_inotify_events_coalesced,
+        METH_VARARGS | METH_KEYWORDS,
+        "read events from an inotify instance, merging duplicates\n\
+\n\
+all merging happens on the raw events before anything is converted:\n\
+\n\
+- repeated events for the same ``(wd, name)`` are reported once, at the\n\
+  position of the first, with all of their masks ORed together\n\
+\n\
+- an ``IN_MOVED_FROM`` and ``IN_MOVED_TO`` with the same cookie are reported\n\
+  as one :class:`inotify_rename<penguin.structs.inotify_rename>`, with both\n\
+  masks ORed together\n\
+\n\
+events with a cookie, ``IN_IGNORED`` and ``IN_Q_OVERFLOW`` are never merged.\n\
+\n\
+:param int fd: file descriptor of the inotify instance\n\
+\n\
+:param float window:\n\
+    after the first read returns, seconds to keep waiting for and reading\n\
+    more events before merging (default 0 to merge just the first read).\n\
+    collection also stops once the buffer is full.\n\
+\n\
+:param int bufsize:\n\
+    the maximum number of bytes of raw events to collect (default 64K)\n\
+\n\
+:returns:\n\
+    a list of :class:`inotify_event<penguin.structs.inotify_event>` and\n\
+    :class:`inotify_rename<penguin.structs.inotify_rename>`\n\
+"},
+
     {"inotify_rm_watch", python_inotify_rm_watch, METH_VARARGS,
         "remove a watch from an inotify instance\n\
 \n\
@@ -605,6 +3021,75 @@ see `man eventfd` for exactly what this does\n\
 \n\
 :param int wd: integer file descriptor for the watch to remove\n\
 "},
+#endif
+
+#ifndef FANOTIFY_MISSING
+    {"fanotify_init", (PyCFunction)python_fanotify_init,
+        METH_VARARGS | METH_KEYWORDS,
+        "create a new fanotify group\n\
+\n\
+see the fanotify_init(2) man page for more details. this generally requires\n\
+the ``CAP_SYS_ADMIN`` capability.\n\
+\n\
+:param int flags:\n\
+    bitwise ORed ``FAN_CLASS_*``, ``FAN_REPORT_*`` and other flags for the new\n\
+    group (default 0). with ``FAN_REPORT_FID`` or ``FAN_REPORT_DFID_NAME``\n\
+    events identify files by file handle rather than an open descriptor.\n\
+\n\
+:param int event_f_flags:\n\
+    the open(2) flags for the file descriptors created for events (default\n\
+    ``O_RDONLY``)\n\
+\n\
+:returns: a file descriptor integer for the new fanotify group\n\
+"},
+
+    {"fanotify_mark", (PyCFunction)python_fanotify_mark,
+        METH_VARARGS | METH_KEYWORDS,
+        "add, remove or modify an fanotify mark on a filesystem object\n\
+\n\
+see the fanotify_mark(2) man page for more details. a single mark with\n\
+``FAN_MARK_MOUNT`` or ``FAN_MARK_FILESYSTEM`` covers a whole mount or\n\
+filesystem, with no per-directory watches.\n\
+\n\
+:param int fd: file descriptor of the fanotify group\n\
+\n\
+:param int flags: bitwise ORed ``FAN_MARK_*`` flags\n\
+\n\
+:param int mask: bitwise ORed events to (un)mark\n\
+\n\
+:param int dirfd:\n\
+    directory file descriptor ``pathname`` is relative to (default\n\
+    ``AT_FDCWD``)\n\
+\n\
+:param str pathname: path of the object to mark (default None for dirfd)\n\
+"},
+
+    {"read_fanotify_events", (PyCFunction)python_read_fanotify_events,
+        METH_VARARGS | METH_KEYWORDS,
+        "read every queued event from a fanotify group at once\n\
+\n\
+:param int fd: file descriptor of the fanotify group\n\
+\n\
+:param int bufsize: the maximum number of bytes of events to read (default 64K)\n\
+\n\
+:returns:\n\
+    a list of :class:`fanotify_event<penguin.structs.fanotify_event>`. the\n\
+    ``fd`` of each must be closed by the caller when it isn't ``FAN_NOFD``.\n\
+    for groups reporting file ids, ``fsid`` is the filesystem id, ``handle``\n\
+    is a packed ``struct file_handle`` suitable for open_by_handle_at(2), and\n\
+    ``name`` is the entry name for ``FAN_REPORT_DFID_NAME`` events. these are\n\
+    ``None`` otherwise.\n\
+"},
+
+    {"fanotify_respond", python_fanotify_respond, METH_VARARGS,
+        "answer a permission event\n\
+\n\
+:param int fd: file descriptor of the fanotify group\n\
+\n\
+:param int event_fd: the ``fd`` of the permission event\n\
+\n\
+:param int response: ``FAN_ALLOW`` or ``FAN_DENY``\n\
+"},
 #endif
 
     {NULL, NULL, 0, NULL}
@@ -619,31 +3104,90 @@ static struct PyModuleDef fds_module = {
 
 PyMODINIT_FUNC
 PyInit_fds(void) {
-    PyObject *module, *datatypes;
+    PyObject *module;
+#ifndef EVENTFD_MISSING
+    if (PyType_Ready(&python_eventfd_type)) return NULL;
+#endif
+#ifndef INOTIFY_MISSING
+    if (PyType_Ready(&python_treewatcher_type)) return NULL;
+#endif
+#ifndef TIMERFD_MISSING
+    if (PyType_Ready(&python_timerwheel_type)) return NULL;
+#endif
     module = PyModule_Create(&fds_module);
 
 #else
 
 PyMODINIT_FUNC
 initfds(void) {
-    PyObject *module, *datatypes;
+    PyObject *module;
+#ifndef EVENTFD_MISSING
+    if (PyType_Ready(&python_eventfd_type)) return;
+#endif
+#ifndef INOTIFY_MISSING
+    if (PyType_Ready(&python_treewatcher_type)) return;
+#endif
+#ifndef TIMERFD_MISSING
+    if (PyType_Ready(&python_timerwheel_type)) return;
+#endif
     module = Py_InitModule("penguin.fds", methods);
 
 #endif
 
-    datatypes = PyImport_ImportModule("penguin.structs");
+    if (!struct_types_ready) {
+        PyStructSequence_InitType(&itimerspec_type, &itimerspec_desc);
+        PyStructSequence_InitType(&siginfo_type, &siginfo_desc);
+        PyStructSequence_InitType(&signalfd_siginfo_type,
+                &signalfd_siginfo_desc);
+        PyStructSequence_InitType(&inotify_event_type, &inotify_event_desc);
+        PyStructSequence_InitType(&inotify_rename_type, &inotify_rename_desc);
+        PyStructSequence_InitType(&tree_event_type, &tree_event_desc);
+        PyStructSequence_InitType(&fanotify_event_type, &fanotify_event_desc);
+        structseq_take_fields(&itimerspec_type);
+        structseq_take_fields(&siginfo_type);
+        structseq_take_fields(&signalfd_siginfo_type);
+        structseq_take_fields(&inotify_event_type);
+        structseq_take_fields(&inotify_rename_type);
+        structseq_take_fields(&tree_event_type);
+        structseq_take_fields(&fanotify_event_type);
+        struct_types_ready = 1;
+    }
 
-    if (NULL != datatypes && PyObject_HasAttrString(datatypes, "itimerspec"))
-        PyItimerspec = PyObject_GetAttrString(datatypes, "itimerspec");
+    Py_INCREF(&itimerspec_type);
+    PyModule_AddObject(module, "itimerspec", (PyObject *)&itimerspec_type);
+    Py_INCREF(&siginfo_type);
+    PyModule_AddObject(module, "siginfo", (PyObject *)&siginfo_type);
+    Py_INCREF(&signalfd_siginfo_type);
+    PyModule_AddObject(module, "signalfd_siginfo",
+            (PyObject *)&signalfd_siginfo_type);
+    Py_INCREF(&inotify_event_type);
+    PyModule_AddObject(module, "inotify_event",
+            (PyObject *)&inotify_event_type);
+    Py_INCREF(&inotify_rename_type);
+    PyModule_AddObject(module, "inotify_rename",
+            (PyObject *)&inotify_rename_type);
+    Py_INCREF(&tree_event_type);
+    PyModule_AddObject(module, "tree_event", (PyObject *)&tree_event_type);
+    Py_INCREF(&fanotify_event_type);
+    PyModule_AddObject(module, "fanotify_event",
+            (PyObject *)&fanotify_event_type);
 
-    if (NULL != datatypes && PyObject_HasAttrString(datatypes, "siginfo"))
-        PySiginfo = PyObject_GetAttrString(datatypes, "siginfo");
+#ifndef EVENTFD_MISSING
+    Py_INCREF(&python_eventfd_type);
+    PyModule_AddObject(module, "Eventfd", (PyObject *)&python_eventfd_type);
+#endif
 
-    if (NULL != datatypes && PyObject_HasAttrString(datatypes, "inotify_event"))
-        PyInotifyEvent = PyObject_GetAttrString(datatypes, "inotify_event");
+#ifndef TIMERFD_MISSING
+    Py_INCREF(&python_timerwheel_type);
+    PyModule_AddObject(module, "TimerWheel",
+            (PyObject *)&python_timerwheel_type);
+#endif
 
-    if (NULL == datatypes)
-        PyErr_Clear();
+#ifndef INOTIFY_MISSING
+    Py_INCREF(&python_treewatcher_type);
+    PyModule_AddObject(module, "TreeWatcher",
+            (PyObject *)&python_treewatcher_type);
+#endif
 
 #ifdef EFD_NONBLOCK
     PyModule_AddIntConstant(module, "EFD_NONBLOCK", EFD_NONBLOCK);
@@ -660,6 +3204,9 @@ initfds(void) {
 #ifdef CLOCK_MONOTONIC
     PyModule_AddIntConstant(module, "CLOCK_MONOTONIC", CLOCK_MONOTONIC);
 #endif
+#ifdef CLOCK_BOOTTIME
+    PyModule_AddIntConstant(module, "CLOCK_BOOTTIME", CLOCK_BOOTTIME);
+#endif
 #ifdef TFD_NONBLOCK
     PyModule_AddIntConstant(module, "TFD_NONBLOCK", TFD_NONBLOCK);
 #endif
@@ -771,6 +3318,148 @@ initfds(void) {
 	PyModule_AddIntConstant(module, "IN_CLOEXEC", IN_CLOEXEC);
 #endif
 
+#ifdef FAN_ACCESS
+    PyModule_AddIntConstant(module, "FAN_ACCESS", FAN_ACCESS);
+#endif
+#ifdef FAN_MODIFY
+    PyModule_AddIntConstant(module, "FAN_MODIFY", FAN_MODIFY);
+#endif
+#ifdef FAN_ATTRIB
+    PyModule_AddIntConstant(module, "FAN_ATTRIB", FAN_ATTRIB);
+#endif
+#ifdef FAN_CLOSE_WRITE
+    PyModule_AddIntConstant(module, "FAN_CLOSE_WRITE", FAN_CLOSE_WRITE);
+#endif
+#ifdef FAN_CLOSE_NOWRITE
+    PyModule_AddIntConstant(module, "FAN_CLOSE_NOWRITE", FAN_CLOSE_NOWRITE);
+#endif
+#ifdef FAN_OPEN
+    PyModule_AddIntConstant(module, "FAN_OPEN", FAN_OPEN);
+#endif
+#ifdef FAN_MOVED_FROM
+    PyModule_AddIntConstant(module, "FAN_MOVED_FROM", FAN_MOVED_FROM);
+#endif
+#ifdef FAN_MOVED_TO
+    PyModule_AddIntConstant(module, "FAN_MOVED_TO", FAN_MOVED_TO);
+#endif
+#ifdef FAN_CREATE
+    PyModule_AddIntConstant(module, "FAN_CREATE", FAN_CREATE);
+#endif
+#ifdef FAN_DELETE
+    PyModule_AddIntConstant(module, "FAN_DELETE", FAN_DELETE);
+#endif
+#ifdef FAN_DELETE_SELF
+    PyModule_AddIntConstant(module, "FAN_DELETE_SELF", FAN_DELETE_SELF);
+#endif
+#ifdef FAN_MOVE_SELF
+    PyModule_AddIntConstant(module, "FAN_MOVE_SELF", FAN_MOVE_SELF);
+#endif
+#ifdef FAN_OPEN_EXEC
+    PyModule_AddIntConstant(module, "FAN_OPEN_EXEC", FAN_OPEN_EXEC);
+#endif
+#ifdef FAN_Q_OVERFLOW
+    PyModule_AddIntConstant(module, "FAN_Q_OVERFLOW", FAN_Q_OVERFLOW);
+#endif
+#ifdef FAN_OPEN_PERM
+    PyModule_AddIntConstant(module, "FAN_OPEN_PERM", FAN_OPEN_PERM);
+#endif
+#ifdef FAN_ACCESS_PERM
+    PyModule_AddIntConstant(module, "FAN_ACCESS_PERM", FAN_ACCESS_PERM);
+#endif
+#ifdef FAN_OPEN_EXEC_PERM
+    PyModule_AddIntConstant(module, "FAN_OPEN_EXEC_PERM", FAN_OPEN_EXEC_PERM);
+#endif
+#ifdef FAN_EVENT_ON_CHILD
+    PyModule_AddIntConstant(module, "FAN_EVENT_ON_CHILD", FAN_EVENT_ON_CHILD);
+#endif
+#ifdef FAN_RENAME
+    PyModule_AddIntConstant(module, "FAN_RENAME", FAN_RENAME);
+#endif
+#ifdef FAN_ONDIR
+    PyModule_AddIntConstant(module, "FAN_ONDIR", FAN_ONDIR);
+#endif
+#ifdef FAN_CLOSE
+    PyModule_AddIntConstant(module, "FAN_CLOSE", FAN_CLOSE);
+#endif
+#ifdef FAN_MOVE
+    PyModule_AddIntConstant(module, "FAN_MOVE", FAN_MOVE);
+#endif
+#ifdef FAN_CLOEXEC
+    PyModule_AddIntConstant(module, "FAN_CLOEXEC", FAN_CLOEXEC);
+#endif
+#ifdef FAN_NONBLOCK
+    PyModule_AddIntConstant(module, "FAN_NONBLOCK", FAN_NONBLOCK);
+#endif
+#ifdef FAN_CLASS_NOTIF
+    PyModule_AddIntConstant(module, "FAN_CLASS_NOTIF", FAN_CLASS_NOTIF);
+#endif
+#ifdef FAN_CLASS_CONTENT
+    PyModule_AddIntConstant(module, "FAN_CLASS_CONTENT", FAN_CLASS_CONTENT);
+#endif
+#ifdef FAN_CLASS_PRE_CONTENT
+    PyModule_AddIntConstant(module, "FAN_CLASS_PRE_CONTENT", FAN_CLASS_PRE_CONTENT);
+#endif
+#ifdef FAN_UNLIMITED_QUEUE
+    PyModule_AddIntConstant(module, "FAN_UNLIMITED_QUEUE", FAN_UNLIMITED_QUEUE);
+#endif
+#ifdef FAN_UNLIMITED_MARKS
+    PyModule_AddIntConstant(module, "FAN_UNLIMITED_MARKS", FAN_UNLIMITED_MARKS);
+#endif
+#ifdef FAN_REPORT_TID
+    PyModule_AddIntConstant(module, "FAN_REPORT_TID", FAN_REPORT_TID);
+#endif
+#ifdef FAN_REPORT_FID
+    PyModule_AddIntConstant(module, "FAN_REPORT_FID", FAN_REPORT_FID);
+#endif
+#ifdef FAN_REPORT_DIR_FID
+    PyModule_AddIntConstant(module, "FAN_REPORT_DIR_FID", FAN_REPORT_DIR_FID);
+#endif
+#ifdef FAN_REPORT_NAME
+    PyModule_AddIntConstant(module, "FAN_REPORT_NAME", FAN_REPORT_NAME);
+#endif
+#ifdef FAN_REPORT_DFID_NAME
+    PyModule_AddIntConstant(module, "FAN_REPORT_DFID_NAME", FAN_REPORT_DFID_NAME);
+#endif
+#ifdef FAN_MARK_ADD
+    PyModule_AddIntConstant(module, "FAN_MARK_ADD", FAN_MARK_ADD);
+#endif
+#ifdef FAN_MARK_REMOVE
+    PyModule_AddIntConstant(module, "FAN_MARK_REMOVE", FAN_MARK_REMOVE);
+#endif
+#ifdef FAN_MARK_DONT_FOLLOW
+    PyModule_AddIntConstant(module, "FAN_MARK_DONT_FOLLOW", FAN_MARK_DONT_FOLLOW);
+#endif
+#ifdef FAN_MARK_ONLYDIR
+    PyModule_AddIntConstant(module, "FAN_MARK_ONLYDIR", FAN_MARK_ONLYDIR);
+#endif
+#ifdef FAN_MARK_IGNORED_MASK
+    PyModule_AddIntConstant(module, "FAN_MARK_IGNORED_MASK", FAN_MARK_IGNORED_MASK);
+#endif
+#ifdef FAN_MARK_IGNORED_SURV_MODIFY
+    PyModule_AddIntConstant(module, "FAN_MARK_IGNORED_SURV_MODIFY", FAN_MARK_IGNORED_SURV_MODIFY);
+#endif
+#ifdef FAN_MARK_FLUSH
+    PyModule_AddIntConstant(module, "FAN_MARK_FLUSH", FAN_MARK_FLUSH);
+#endif
+#ifdef FAN_MARK_INODE
+    PyModule_AddIntConstant(module, "FAN_MARK_INODE", FAN_MARK_INODE);
+#endif
+#ifdef FAN_MARK_MOUNT
+    PyModule_AddIntConstant(module, "FAN_MARK_MOUNT", FAN_MARK_MOUNT);
+#endif
+#ifdef FAN_MARK_FILESYSTEM
+    PyModule_AddIntConstant(module, "FAN_MARK_FILESYSTEM", FAN_MARK_FILESYSTEM);
+#endif
+#ifdef FAN_ALLOW
+    PyModule_AddIntConstant(module, "FAN_ALLOW", FAN_ALLOW);
+#endif
+#ifdef FAN_DENY
+    PyModule_AddIntConstant(module, "FAN_DENY", FAN_DENY);
+#endif
+#ifdef FAN_NOFD
+    PyModule_AddIntConstant(module, "FAN_NOFD", FAN_NOFD);
+#endif
+
 #if PY_MAJOR_VERSION >= 3
     return module;
 #endif
@@ -0,0 +1,616 @@
+#include "common.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+
+/*
+ * the event loop
+ *
+ * a Loop is an epoll instance plus a table, indexed by file descriptor, of
+ * what kind of penguin fd each registered descriptor is and the callback to
+ * pass its decoded events to. eventfds and timerfds are read right here;
+ * the fds whose events have more structure go to the batched readers of
+ * penguin.fds. those are called through their python function objects, but
+ * they're C themselves, so no python code runs between one ready fd's
+ * callback and the next.
+ */
+
+#define KIND_RAW      0
+#define KIND_EVENTFD  1
+#define KIND_TIMERFD  2
+#define KIND_SIGNALFD 3
+#define KIND_INOTIFY  4
+#define KIND_FANOTIFY 5
+#define KIND_COUNT    6
+
+/* the penguin.fds batch readers, by kind. NULL for those read in C */
+static PyObject *decoders[KIND_COUNT];
+
+typedef struct {
+    int kind;
+    PyObject *callback;
+} registration;
+
+typedef struct {
+    PyObject_HEAD
+    int epfd;
+    int maxevents;
+    struct epoll_event *events;
+    registration **table;
+    int size;
+    int count;
+} python_loop_object;
+
+static char *loop_kwargs[] = {"maxevents", NULL};
+
+static PyObject *
+python_loop_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_loop_object *self;
+    int maxevents = 64;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", loop_kwargs,
+                &maxevents))
+        return NULL;
+
+    if (maxevents <= 0) {
+        PyErr_SetString(PyExc_ValueError, "maxevents must be positive");
+        return NULL;
+    }
+
+    if (!(self = (python_loop_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->epfd = -1;
+    self->maxevents = maxevents;
+    self->table = NULL;
+    self->size = self->count = 0;
+
+    if (!(self->events = malloc(sizeof(struct epoll_event) * maxevents))) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+
+    if ((self->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+/* drop every registration. the table is detached first, since releasing a
+ * callback can run arbitrary code, which might come back to this loop */
+static void
+loop_clear_table(python_loop_object *self) {
+    registration **table = self->table;
+    int i, size = self->size;
+
+    self->table = NULL;
+    self->size = self->count = 0;
+
+    for (i = 0; i < size; ++i) {
+        if (NULL != table[i]) {
+            Py_DECREF(table[i]->callback);
+            free(table[i]);
+        }
+    }
+    free(table);
+}
+
+/* the callbacks are often bound methods of objects that hold the loop */
+static int
+python_loop_traverse(python_loop_object *self, visitproc visit, void *arg) {
+    int i;
+
+    for (i = 0; i < self->size; ++i) {
+        if (NULL != self->table[i])
+            Py_VISIT(self->table[i]->callback);
+    }
+    return 0;
+}
+
+static int
+python_loop_clear(python_loop_object *self) {
+    loop_clear_table(self);
+    return 0;
+}
+
+static void
+python_loop_dealloc(python_loop_object *self) {
+    PyObject_GC_UnTrack(self);
+    loop_clear_table(self);
+    free(self->events);
+
+    if (self->epfd >= 0)
+        close(self->epfd);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+python_loop_length(python_loop_object *self) {
+    return (Py_ssize_t)self->count;
+}
+
+static int
+loop_check(python_loop_object *self) {
+    if (self->epfd < 0) {
+        PyErr_SetString(PyExc_ValueError, "Loop is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static char *register_kwargs[] = {"fd", "kind", "callback", NULL};
+
+static PyObject *
+python_loop_register(python_loop_object *self, PyObject *args,
+        PyObject *kwargs) {
+    int fd, kind, size;
+    PyObject *callback;
+    registration *reg, **table;
+    struct epoll_event event;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iiO", register_kwargs,
+                &fd, &kind, &callback))
+        return NULL;
+
+    if (loop_check(self))
+        return NULL;
+
+    if (kind < 0 || kind >= KIND_COUNT) {
+        PyErr_SetString(PyExc_ValueError, "unknown fd kind");
+        return NULL;
+    }
+
+    if (kind >= KIND_SIGNALFD && NULL == decoders[kind]) {
+        PyErr_SetString(PyExc_ValueError,
+                "fd kind not supported by penguin.fds on this system");
+        return NULL;
+    }
+
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+
+    if (fd < 0) {
+        errno = EBADF;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (fd < self->size && NULL != self->table[fd]) {
+        errno = EEXIST;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (fd >= self->size) {
+        for (size = self->size ? self->size : 64; size <= fd; size *= 2);
+        if (!(table = realloc(self->table, sizeof(registration *) * size)))
+            return PyErr_NoMemory();
+        memset(table + self->size, 0,
+                sizeof(registration *) * (size - self->size));
+        self->table = table;
+        self->size = size;
+    }
+
+    if (!(reg = malloc(sizeof(registration))))
+        return PyErr_NoMemory();
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        free(reg);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(callback);
+    reg->kind = kind;
+    reg->callback = callback;
+    self->table[fd] = reg;
+    self->count++;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_loop_unregister(python_loop_object *self, PyObject *args) {
+    int fd;
+    registration *reg;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+
+    if (loop_check(self))
+        return NULL;
+
+    if (fd < 0 || fd >= self->size || NULL == (reg = self->table[fd])) {
+        PyErr_SetString(PyExc_KeyError, "fd is not registered");
+        return NULL;
+    }
+
+    self->table[fd] = NULL;
+    self->count--;
+    Py_DECREF(reg->callback);
+    free(reg);
+
+    /* the fd may have been closed already, which drops it from the set */
+    if (epoll_ctl(self->epfd, EPOLL_CTL_DEL, fd, NULL) < 0 &&
+            EBADF != errno && ENOENT != errno) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/* read and decode what's waiting on a ready fd. None if there was nothing */
+static PyObject *
+loop_decode(int fd, int kind) {
+    uint64_t value;
+
+    switch (kind) {
+    case KIND_RAW:
+        return PyInt_FromLong((long)fd);
+
+    case KIND_EVENTFD:
+    case KIND_TIMERFD:
+        if (read(fd, &value, sizeof(value)) < 0) {
+            if (EAGAIN == errno) {
+                Py_INCREF(Py_None);
+                return Py_None;
+            }
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        return PyLong_FromUnsignedLongLong((unsigned PY_LONG_LONG)value);
+
+    default:
+        return PyObject_CallFunction(decoders[kind], "i", fd);
+    }
+}
+
+/* swallow the pending exception if it's an EAGAIN from a decoder */
+static int
+loop_eagain(void) {
+    PyObject *type, *value, *traceback, *err;
+    int match = 0;
+
+    if (!PyErr_ExceptionMatches(PyExc_OSError) &&
+            !PyErr_ExceptionMatches(PyExc_IOError))
+        return 0;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    if (NULL != value &&
+            NULL != (err = PyObject_GetAttrString(value, "errno"))) {
+        match = PyInt_Check(err) || PyLong_Check(err) ?
+            EAGAIN == PyInt_AsLong(err) : 0;
+        Py_DECREF(err);
+    }
+    PyErr_Clear();
+
+    if (match) {
+        Py_XDECREF(type);
+        Py_XDECREF(value);
+        Py_XDECREF(traceback);
+    } else
+        PyErr_Restore(type, value, traceback);
+
+    return match;
+}
+
+/* epoll_wait's timeout in ms, rounded up so a short wait doesn't spin */
+static int
+timeout_ms(double secs) {
+    double ms = secs * 1000;
+
+    if (ms >= INT_MAX)
+        return INT_MAX;
+    return (int)ms + ((int)ms < ms);
+}
+
+static char *run_once_kwargs[] = {"timeout", NULL};
+
+static PyObject *
+python_loop_run_once(python_loop_object *self, PyObject *args,
+        PyObject *kwargs) {
+    double timeout = -1, deadline = 0, left;
+    int count, i, fd, ms, dispatched = 0;
+    registration *reg;
+    PyObject *callback, *arg, *result;
+    struct timespec now;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|d", run_once_kwargs,
+                &timeout))
+        return NULL;
+
+    if (loop_check(self))
+        return NULL;
+
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = now.tv_sec + now.tv_nsec / 1e9 + timeout;
+    }
+    ms = timeout < 0 ? -1 : timeout_ms(timeout);
+
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+        count = epoll_wait(self->epfd, self->events, self->maxevents, ms);
+        Py_END_ALLOW_THREADS
+
+        if (count >= 0)
+            break;
+
+        /* PEP 475: run the signal handlers, then go back to waiting for
+         * whatever is left of the timeout */
+        if (EINTR != errno) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        if (PyErr_CheckSignals())
+            return NULL;
+        /* a handler may have closed the loop */
+        if (loop_check(self))
+            return NULL;
+        if (timeout >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left = deadline - now.tv_sec - now.tv_nsec / 1e9;
+            ms = left > 0 ? timeout_ms(left) : 0;
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        fd = self->events[i].data.fd;
+
+        /* an earlier callback may have unregistered this one */
+        if (fd >= self->size || NULL == (reg = self->table[fd]))
+            continue;
+
+        /* and this one may unregister itself */
+        callback = reg->callback;
+        Py_INCREF(callback);
+
+        if (NULL == (arg = loop_decode(fd, reg->kind))) {
+            Py_DECREF(callback);
+            /* another reader got there first */
+            if (loop_eagain())
+                continue;
+            return NULL;
+        }
+
+        /* an eventfd or timerfd that had already been drained */
+        if (Py_None == arg) {
+            Py_DECREF(arg);
+            Py_DECREF(callback);
+            continue;
+        }
+
+        result = PyObject_CallFunctionObjArgs(callback, arg, NULL);
+        Py_DECREF(arg);
+        Py_DECREF(callback);
+        if (NULL == result)
+            /* epoll is level triggered, so any events still unhandled in
+             * this batch will simply be reported again by the next call */
+            return NULL;
+        Py_DECREF(result);
+        dispatched++;
+    }
+
+    return PyInt_FromLong((long)dispatched);
+}
+
+static PyObject *
+python_loop_fileno(python_loop_object *self, PyObject *iamnull) {
+    return PyInt_FromLong((long)self->epfd);
+}
+
+static PyObject *
+python_loop_close(python_loop_object *self, PyObject *iamnull) {
+    loop_clear_table(self);
+
+    if (self->epfd >= 0 && close(self->epfd) < 0) {
+        self->epfd = -1;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->epfd = -1;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyMethodDef loop_methods[] = {
+    {"register", (PyCFunction)python_loop_register,
+        METH_VARARGS | METH_KEYWORDS,
+        "add a file descriptor to the loop\n\
+\n\
+the fd should be nonblocking, so a callback that reads it itself can't\n\
+stall the loop.\n\
+\n\
+:param int fd: the file descriptor to watch for readability\n\
+\n\
+:param int kind:\n\
+    how to read the fd when it's ready, and so what the callback receives\n\
+\n\
+    - ``KIND_RAW``: nothing is read, the callback gets the fd itself\n\
+    - ``KIND_EVENTFD``: the eventfd's counter\n\
+    - ``KIND_TIMERFD``: the timerfd's expiration count\n\
+    - ``KIND_SIGNALFD``: a list from :func:`penguin.fds.read_signalfd_many`\n\
+    - ``KIND_INOTIFY``: a list from :func:`penguin.fds.read_inotify_events`\n\
+    - ``KIND_FANOTIFY``: a list from :func:`penguin.fds.read_fanotify_events`\n\
+\n\
+:param callback: a callable taking a single argument\n\
+"},
+    {"unregister", (PyCFunction)python_loop_unregister, METH_VARARGS,
+        "remove a file descriptor from the loop\n\
+\n\
+:param int fd: a registered file descriptor\n\
+\n\
+:raises KeyError: if the fd isn't registered\n\
+"},
+    {"run_once", (PyCFunction)python_loop_run_once,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait for ready fds and dispatch them all to their callbacks\n\
+\n\
+if a callback raises, the exception propagates immediately and any other\n\
+fds that were ready are left to the next call.\n\
+\n\
+:param float timeout:\n\
+    maximum seconds to wait for any fd to become ready (default of -1 waits\n\
+    indefinitely)\n\
+\n\
+:returns: the number of callbacks that were called\n\
+"},
+    {"fileno", (PyCFunction)python_loop_fileno, METH_NOARGS,
+        "get the file descriptor of the underlying epoll instance\n\
+\n\
+it becomes readable when any registered fd is, so a Loop can be nested in\n\
+another event loop.\n\
+\n\
+:returns: integer file descriptor\n\
+"},
+    {"close", (PyCFunction)python_loop_close, METH_NOARGS,
+        "close the underlying epoll instance\n\
+\n\
+every fd is unregistered, and the references to the callbacks dropped.\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods loop_as_sequence = {
+    (lenfunc)python_loop_length,               /* sq_length */
+};
+
+static PyTypeObject python_loop_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.loop.Loop",                       /* tp_name */
+    sizeof(python_loop_object),                /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_loop_dealloc,           /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &loop_as_sequence,                         /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,   /* tp_flags */
+    "Loop(maxevents=64)\n\
+\n\
+an epoll-based loop that reads and decodes penguin fds as they become\n\
+ready and passes the results to callbacks\n\
+\n\
+``maxevents`` is the most ready fds handled by a single :meth:`run_once`.\n\
+the length of a Loop is the number of registered fds.", /* tp_doc */
+    (traverseproc)python_loop_traverse,        /* tp_traverse */
+    (inquiry)python_loop_clear,                /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    loop_methods,                              /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_loop_new,                           /* tp_new */
+    PyObject_GC_Del,                           /* tp_free */
+};
+
+
+/*
+ * module
+ */
+
+static PyMethodDef methods[] = {
+    {NULL, NULL, 0, NULL}
+};
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef loop_module = {
+    PyModuleDef_HEAD_INIT,
+    "penguin.loop", "", -1, methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC
+PyInit_loop(void) {
+    PyObject *module, *fds;
+    if (PyType_Ready(&python_loop_type)) return NULL;
+    module = PyModule_Create(&loop_module);
+
+#else
+
+PyMODINIT_FUNC
+initloop(void) {
+    PyObject *module, *fds;
+    if (PyType_Ready(&python_loop_type)) return;
+    module = Py_InitModule("penguin.loop", methods);
+
+#endif
+
+    /* kinds whose reader penguin.fds lacks on this system stay unusable */
+    fds = PyImport_ImportModule("penguin.fds");
+
+    if (NULL != fds && PyObject_HasAttrString(fds, "read_signalfd_many"))
+        decoders[KIND_SIGNALFD] = PyObject_GetAttrString(fds,
+                "read_signalfd_many");
+
+    if (NULL != fds && PyObject_HasAttrString(fds, "read_inotify_events"))
+        decoders[KIND_INOTIFY] = PyObject_GetAttrString(fds,
+                "read_inotify_events");
+
+    if (NULL != fds && PyObject_HasAttrString(fds, "read_fanotify_events"))
+        decoders[KIND_FANOTIFY] = PyObject_GetAttrString(fds,
+                "read_fanotify_events");
+
+    if (NULL == fds)
+        PyErr_Clear();
+    else
+        Py_DECREF(fds);
+
+    Py_INCREF(&python_loop_type);
+    PyModule_AddObject(module, "Loop", (PyObject *)&python_loop_type);
+
+    PyModule_AddIntConstant(module, "KIND_RAW", KIND_RAW);
+    PyModule_AddIntConstant(module, "KIND_EVENTFD", KIND_EVENTFD);
+    PyModule_AddIntConstant(module, "KIND_TIMERFD", KIND_TIMERFD);
+    PyModule_AddIntConstant(module, "KIND_SIGNALFD", KIND_SIGNALFD);
+    PyModule_AddIntConstant(module, "KIND_INOTIFY", KIND_INOTIFY);
+    PyModule_AddIntConstant(module, "KIND_FANOTIFY", KIND_FANOTIFY);
+
+#if PY_MAJOR_VERSION >= 3
+    return module;
+#endif
+}
@@ -0,0 +1 @@
+#define FANOTIFY_MISSING
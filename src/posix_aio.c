@@ -1,38 +1,1432 @@
 #include "src/common.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <unistd.h>
+#include <time.h>
 #include <aio.h>
+#include <sys/eventfd.h>
 
 
 #ifdef _POSIX_ASYNCHRONOUS_IO
+
+/* which implementation an aiocb was submitted to */
+#define BACKEND_LIBC 0
+#define BACKEND_POOL 1
+
+/* operation codes, shared by both backends */
+#define AIO_OP_READ  0
+#define AIO_OP_WRITE 1
+#define AIO_OP_FSYNC 2
+#define AIO_OP_DSYNC 3
+
+/* lifecycle of an aiocb in the worker pool */
+#define JOB_QUEUED  0
+#define JOB_RUNNING 1
+#define JOB_DONE    2
+
+typedef struct python_aiocb_object {
+    PyObject_HEAD
+    char own_buf;
+    char backend;
+    char op;
+    int state;
+    int error;
+    ssize_t result;
+    size_t bufsize;
+    PyObject *waiter;
+    struct python_aiocb_object *next_done;
+    struct aiocb cb;
+} python_aiocb_object;
+
+
+/*
+ * aiocb free lists
+ *
+ * when enabled, read buffers are rounded up to a power-of-2 size class and
+ * dead aiocbs are kept along with their buffers (chained through next_done)
+ * for build_aiocb to hand out again, instead of going back to the allocator.
+ */
+
+#define FREELIST_MIN_SIZE 512
+#define FREELIST_CLASSES  12 /* 512 bytes up to 1MB */
+
+static python_aiocb_object *freelist[FREELIST_CLASSES];
+static Py_ssize_t freelist_count[FREELIST_CLASSES];
+static Py_ssize_t freelist_cap = 0;
+static unsigned PY_LONG_LONG freelist_hits = 0;
+static unsigned PY_LONG_LONG freelist_misses = 0;
+
+/* returns -1 for sizes too big to be pooled */
+static int
+size_class(size_t nbytes) {
+    int k;
+    size_t size = FREELIST_MIN_SIZE;
+
+    for (k = 0; k < FREELIST_CLASSES; ++k, size <<= 1) {
+        if (nbytes <= size) return k;
+    }
+    return -1;
+}
+
+static void
+freelist_trim(Py_ssize_t cap) {
+    python_aiocb_object *pyaiocb;
+    int k;
+
+    for (k = 0; k < FREELIST_CLASSES; ++k) {
+        while (freelist_count[k] > cap) {
+            pyaiocb = freelist[k];
+            freelist[k] = pyaiocb->next_done;
+            --freelist_count[k];
+            free((void *)pyaiocb->cb.aio_buf);
+            PyObject_Del(pyaiocb);
+        }
+    }
+}
+
+static void
+python_aiocb_dealloc(python_aiocb_object *self) {
+    int k;
+
+    Py_CLEAR(self->waiter);
+
+    /* a libc request dropped in flight still has glibc writing to it, so it
+     * mustn't be handed out again */
+    if (self->own_buf && freelist_cap > 0 &&
+            (BACKEND_LIBC != self->backend ||
+                EINPROGRESS != aio_error(&self->cb)) &&
+            (k = size_class(self->bufsize)) >= 0 &&
+            self->bufsize == (size_t)FREELIST_MIN_SIZE << k &&
+            freelist_count[k] < freelist_cap) {
+        self->next_done = freelist[k];
+        freelist[k] = self;
+        ++freelist_count[k];
+        return;
+    }
+
+    if (self->own_buf) free((void *)self->cb.aio_buf);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyTypeObject python_aiocb_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_aio.aiocb",                 /* tp_name */
+    sizeof(python_aiocb_object),               /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_aiocb_dealloc,          /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    0,                                         /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    0,                                         /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    0,                                         /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    PyType_GenericNew,                         /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+
+/*
+ * in-extension worker pool
+ *
+ * glibc serializes requests per file descriptor, so this is an alternative
+ * backend: a fixed set of pthreads each owning a deque of aiocbs. the
+ * submitting thread deals new requests round-robin onto the bottoms of the
+ * deques, a worker pops from the bottom of its own and steals from the top of
+ * the others' when it runs dry. every completion bumps the pool's eventfd.
+ *
+ * the pool holds a reference to each aiocb from submission until it leaves
+ * the deques. workers can't touch refcounts without the GIL, so finished
+ * aiocbs are chained onto the `done` list and released by the next python
+ * call into the module. aiocbs with an asyncio future waiting on them go on
+ * the `resolved` list instead, for the eventfd reader on the event loop.
+ *
+ * stopping takes two steps. with the GIL held the pool is marked stopping, so
+ * nothing new is submitted to it, then the workers drain their deques and are
+ * joined without the GIL. threads waiting on the pool's lock and condition
+ * without the GIL hold a reference (counted under the GIL) so the pool isn't
+ * freed under them.
+ */
+
+typedef struct {
+    pthread_mutex_t lock;
+    python_aiocb_object **jobs;
+    size_t size; /* always a power of 2 */
+    size_t top;
+    size_t bottom;
+} job_deque;
+
+typedef struct {
+    int nworkers;
+    int evfd;
+    char stopping;
+    char implicit; /* started by the asyncio adapter, and only serving it */
+    int refs;
+    unsigned int next;
+    long pending;
+    pthread_t *threads;
+    job_deque *deques;
+    python_aiocb_object **running; /* each worker's job, for aio_cancel */
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_cond_t finished;
+    python_aiocb_object *done;
+    python_aiocb_object *resolved;
+} worker_pool;
+
+static worker_pool *pool = NULL;
+
+#define DEQUE_INITIAL_SIZE 64
+
+static int
+deque_init(job_deque *dq) {
+    if (!(dq->jobs = malloc(DEQUE_INITIAL_SIZE * sizeof(*dq->jobs))))
+        return -1;
+    dq->size = DEQUE_INITIAL_SIZE;
+    dq->top = dq->bottom = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+static void
+deque_destroy(job_deque *dq) {
+    pthread_mutex_destroy(&dq->lock);
+    free(dq->jobs);
+}
+
+static int
+deque_push(job_deque *dq, python_aiocb_object *job) {
+    python_aiocb_object **jobs;
+    size_t i, count;
+
+    pthread_mutex_lock(&dq->lock);
+    count = dq->bottom - dq->top;
+    if (count == dq->size) {
+        if (!(jobs = malloc(2 * dq->size * sizeof(*jobs)))) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (i = 0; i < count; ++i)
+            jobs[i] = dq->jobs[(dq->top + i) & (dq->size - 1)];
+        free(dq->jobs);
+        dq->jobs = jobs;
+        dq->size *= 2;
+        dq->top = 0;
+        dq->bottom = count;
+    }
+    dq->jobs[dq->bottom++ & (dq->size - 1)] = job;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+/*
+ * a job leaves the deque and shows up in the worker's running slot under the
+ * deque's lock, so pool_cancel_fd always finds it in one or the other
+ */
+static python_aiocb_object *
+deque_pop(job_deque *dq, python_aiocb_object **running) {
+    python_aiocb_object *job = NULL;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top) {
+        job = dq->jobs[--dq->bottom & (dq->size - 1)];
+        __atomic_store_n(running, job, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+static python_aiocb_object *
+deque_steal(job_deque *dq, python_aiocb_object **running) {
+    python_aiocb_object *job = NULL;
+
+    /* a thief backs off rather than wait on a contended deque */
+    if (pthread_mutex_trylock(&dq->lock))
+        return NULL;
+    if (dq->bottom != dq->top) {
+        job = dq->jobs[dq->top++ & (dq->size - 1)];
+        __atomic_store_n(running, job, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+static void
+run_job(python_aiocb_object *job, python_aiocb_object **running) {
+    struct aiocb *cb = &job->cb;
+    ssize_t rc;
+    int expected = JOB_QUEUED;
+
+    /* lose this race and the job was canceled while still queued */
+    if (__atomic_compare_exchange_n(&job->state, &expected, JOB_RUNNING, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        switch (job->op) {
+        case AIO_OP_READ:
+            rc = pread(cb->aio_fildes, (void *)cb->aio_buf, cb->aio_nbytes,
+                    cb->aio_offset);
+            break;
+        case AIO_OP_WRITE:
+            rc = pwrite(cb->aio_fildes, (const void *)cb->aio_buf,
+                    cb->aio_nbytes, cb->aio_offset);
+            break;
+        case AIO_OP_FSYNC:
+            rc = fsync(cb->aio_fildes);
+            break;
+        case AIO_OP_DSYNC:
+            rc = fdatasync(cb->aio_fildes);
+            break;
+        default:
+            rc = -1;
+            errno = EINVAL;
+        }
+
+        job->result = rc;
+        job->error = rc < 0 ? errno : 0;
+        __atomic_store_n(&job->state, JOB_DONE, __ATOMIC_RELEASE);
+
+        if (SIGEV_SIGNAL == cb->aio_sigevent.sigev_notify)
+            kill(getpid(), cb->aio_sigevent.sigev_signo);
+    }
+
+    /* before the job can be released and freed from the done list */
+    __atomic_store_n(running, NULL, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&pool->lock);
+    if (NULL != job->waiter) {
+        job->next_done = pool->resolved;
+        pool->resolved = job;
+    } else {
+        job->next_done = pool->done;
+        pool->done = job;
+    }
+    pthread_cond_broadcast(&pool->finished);
+    pthread_mutex_unlock(&pool->lock);
+
+    eventfd_write(pool->evfd, 1);
+}
+
+static void *
+pool_worker(void *arg) {
+    int self = (int)(intptr_t)arg, i;
+    python_aiocb_object *job;
+
+    for (;;) {
+        job = deque_pop(&pool->deques[self], &pool->running[self]);
+        for (i = 1; NULL == job && i < pool->nworkers; ++i)
+            job = deque_steal(&pool->deques[(self + i) % pool->nworkers],
+                    &pool->running[self]);
+
+        if (NULL != job) {
+            __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+            run_job(job, &pool->running[self]);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE)
+                && !pool->stopping)
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        if (pool->stopping && !__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* drop the pool's references to finished aiocbs. the GIL must be held */
+static void
+pool_release_done(void) {
+    python_aiocb_object *job, *next;
+
+    if (NULL == pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    job = pool->done;
+    pool->done = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (; NULL != job; job = next) {
+        next = job->next_done;
+        Py_DECREF(job);
+    }
+}
+
+static int
+pool_submit(python_aiocb_object *job) {
+    job_deque *dq = &pool->deques[pool->next++ % pool->nworkers];
+
+    job->backend = BACKEND_POOL;
+    job->state = JOB_QUEUED;
+    job->error = EINPROGRESS;
+    job->result = -1;
+
+    Py_INCREF(job);
+    if (deque_push(dq, job)) {
+        Py_DECREF(job);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_release_done();
+    return 0;
+}
+
+/* try to cancel a job that's still queued. returns an AIO_* status */
+static int
+pool_cancel_job(python_aiocb_object *job) {
+    int expected = JOB_QUEUED;
+
+    if (__atomic_compare_exchange_n(&job->state, &expected, JOB_RUNNING, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        job->result = -1;
+        job->error = ECANCELED;
+        __atomic_store_n(&job->state, JOB_DONE, __ATOMIC_RELEASE);
+        return AIO_CANCELED;
+    }
+
+    return JOB_DONE == expected ? AIO_ALLDONE : AIO_NOTCANCELED;
+}
+
+/* cancel every queued job for fd. the GIL must be held */
+static int
+pool_cancel_fd(int fd) {
+    int i, rc, canceled = 0, notcanceled = 0;
+    size_t j;
+    job_deque *dq;
+    python_aiocb_object *job;
+
+    for (i = 0; i < pool->nworkers; ++i) {
+        dq = &pool->deques[i];
+        pthread_mutex_lock(&dq->lock);
+        for (j = dq->top; j != dq->bottom; ++j) {
+            job = dq->jobs[j & (dq->size - 1)];
+            if (fd != job->cb.aio_fildes) continue;
+            rc = pool_cancel_job(job);
+            canceled |= AIO_CANCELED == rc;
+            notcanceled |= AIO_NOTCANCELED == rc;
+        }
+        pthread_mutex_unlock(&dq->lock);
+    }
+
+    /* anything that left a deque before we got to it is in a running slot
+     * by now. holding the GIL keeps it from being freed. */
+    for (i = 0; i < pool->nworkers; ++i) {
+        job = __atomic_load_n(&pool->running[i], __ATOMIC_ACQUIRE);
+        if (NULL != job && fd == job->cb.aio_fildes &&
+                JOB_DONE != __atomic_load_n(&job->state, __ATOMIC_ACQUIRE))
+            notcanceled = 1;
+    }
+
+    if (notcanceled)
+        return AIO_NOTCANCELED;
+    return canceled ? AIO_CANCELED : AIO_ALLDONE;
+}
+
+static void
+pool_free(worker_pool *p) {
+    int i;
+
+    for (i = 0; i < p->nworkers; ++i)
+        deque_destroy(&p->deques[i]);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_cond_destroy(&p->finished);
+    pthread_mutex_destroy(&p->lock);
+    if (p->evfd >= 0) close(p->evfd);
+    free(p->deques);
+    free(p->threads);
+    free(p->running);
+    free(p);
+}
+
+/* a reference to the pool for waiting on it without the GIL. may be NULL */
+static worker_pool *
+pool_ref(void) {
+    if (NULL != pool)
+        pool->refs++;
+    return pool;
+}
+
+/* the GIL must be held */
+static void
+pool_unref(worker_pool *p) {
+    if (NULL != p && !--p->refs)
+        pool_free(p);
+}
+
+static int
+pool_running(void) {
+    return NULL != pool && !pool->stopping;
+}
+
+static void pool_resolve_waiters(void);
+static void unregister_loop(void);
+
+static void
+pool_stop(void) {
+    worker_pool *p = pool;
+    int i;
+
+    /* with the GIL still held, so no request can slip in after this */
+    pthread_mutex_lock(&p->lock);
+    p->stopping = 1;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 0; i < p->nworkers; ++i)
+        pthread_join(p->threads[i], NULL);
+    Py_END_ALLOW_THREADS
+
+    pool_release_done();
+    pool_resolve_waiters();
+    unregister_loop();
+    pool = NULL;
+    pool_unref(p);
+}
+
+static int
+pool_start(int nworkers) {
+    worker_pool *p;
+    pthread_condattr_t attr;
+    int i;
+
+    if (!(p = calloc(1, sizeof(worker_pool))))
+        return -1;
+    p->evfd = -1;
+    p->refs = 1;
+
+    if (!(p->threads = calloc(nworkers, sizeof(pthread_t))) ||
+            !(p->running = calloc(nworkers, sizeof(python_aiocb_object *))) ||
+            !(p->deques = calloc(nworkers, sizeof(job_deque)))) {
+        pool_free(p);
+        return -1;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->finished, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (i = 0; i < nworkers; ++i) {
+        if (deque_init(&p->deques[i])) {
+            pool_free(p);
+            return -1;
+        }
+        p->nworkers = i + 1;
+    }
+
+    if ((p->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        pool_free(p);
+        return -1;
+    }
+
+    pool = p;
+    for (i = 0; i < nworkers; ++i) {
+        if ((errno = pthread_create(&p->threads[i], NULL, pool_worker,
+                        (void *)(intptr_t)i))) {
+            p->nworkers = i;
+            pool_stop();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * aiocb helpers that dispatch on the backend
+ */
+
+static int
+submit_aiocb(python_aiocb_object *pyaiocb, int op) {
+    pyaiocb->op = op;
+
+    if (pool_running() && !pool->implicit)
+        return pool_submit(pyaiocb);
+
+    pyaiocb->backend = BACKEND_LIBC;
+    switch (op) {
+    case AIO_OP_READ:
+        return aio_read(&pyaiocb->cb);
+    case AIO_OP_WRITE:
+        return aio_write(&pyaiocb->cb);
+    case AIO_OP_FSYNC:
+        return aio_fsync(O_SYNC, &pyaiocb->cb);
+    case AIO_OP_DSYNC:
+        return aio_fsync(O_DSYNC, &pyaiocb->cb);
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+static int
+aiocb_error(python_aiocb_object *pyaiocb) {
+    if (BACKEND_LIBC == pyaiocb->backend)
+        return aio_error(&pyaiocb->cb);
+
+    if (JOB_DONE != __atomic_load_n(&pyaiocb->state, __ATOMIC_ACQUIRE))
+        return EINPROGRESS;
+    return pyaiocb->error;
+}
+
+static ssize_t
+aiocb_return(python_aiocb_object *pyaiocb) {
+    if (BACKEND_LIBC == pyaiocb->backend)
+        return aio_return(&pyaiocb->cb);
+    return pyaiocb->result;
+}
+
+/*
+ * waiting on aiocbs from either backend
+ */
+
+static int
+timespec_ify(PyObject *pytimeout, struct timespec *result) {
+    double timeout;
+    long seconds;
+
+    if (pytimeout == Py_None) return 1;
+    else {
+        if (-1 == (timeout = PyFloat_AsDouble(pytimeout)) && PyErr_Occurred())
+            return -1;
+        seconds = (long)timeout;
+        timeout = timeout - (double)seconds;
+        result->tv_sec = seconds;
+        result->tv_nsec = (long)(timeout * 1E9);
+    }
+
+    return 0;
+}
+
+static int
+aiocbs_finished(python_aiocb_object **cbs, Py_ssize_t count, char all) {
+    Py_ssize_t i, done = 0;
+
+    for (i = 0; i < count; ++i) {
+        if (EINPROGRESS != aiocb_error(cbs[i])) ++done;
+    }
+
+    return all ? done == count : done > 0 || !count;
+}
+
+/* turn a relative timeout (or NULL for none) into a CLOCK_MONOTONIC deadline */
+static struct timespec *
+deadline_ify(const struct timespec *timeout, struct timespec *deadline) {
+    if (NULL == timeout) return NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout->tv_sec;
+    deadline->tv_nsec += timeout->tv_nsec;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+
+    return deadline;
+}
+
+/*
+ * block until all (or any) of the aiocbs have finished, or the deadline from
+ * deadline_ify() passes. call without the GIL, holding a reference to the
+ * pool from pool_ref().
+ * returns 0, or -1 with errno set to EAGAIN for a timeout or EINTR. after
+ * EINTR call again with the same deadline to carry on waiting.
+ */
+static int
+wait_aiocbs(worker_pool *p, python_aiocb_object **cbs, Py_ssize_t count,
+        char all, const struct timespec *deadline) {
+    struct timespec now, remaining;
+    const struct aiocb **libc_cbs;
+    Py_ssize_t i, nlibc;
+    char pooled;
+    int rc = 0;
+
+    if (!(libc_cbs = malloc((count ? count : 1) * sizeof(struct aiocb *)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (;;) {
+        if (aiocbs_finished(cbs, count, all))
+            break;
+
+        remaining.tv_sec = remaining.tv_nsec = 0;
+        if (NULL != deadline) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+            if (remaining.tv_nsec < 0) {
+                remaining.tv_sec -= 1;
+                remaining.tv_nsec += 1000000000;
+            }
+        }
+        if (NULL != deadline && remaining.tv_sec < 0) {
+            errno = EAGAIN;
+            rc = -1;
+            break;
+        }
+
+        nlibc = 0;
+        pooled = 0;
+        for (i = 0; i < count; ++i) {
+            if (EINPROGRESS != aiocb_error(cbs[i])) continue;
+            if (BACKEND_LIBC == cbs[i]->backend)
+                libc_cbs[nlibc++] = &cbs[i]->cb;
+            else
+                pooled = 1;
+        }
+
+        if (!pooled || NULL == p) {
+            if (aio_suspend(libc_cbs, nlibc, deadline ? &remaining : NULL) &&
+                    EAGAIN != errno) {
+                rc = -1;
+                break;
+            }
+            continue;
+        }
+
+        /* with libc requests in the mix too, wake up to poll them */
+        if (nlibc && (NULL == deadline || remaining.tv_sec > 0 ||
+                    remaining.tv_nsec > 10000000)) {
+            remaining.tv_sec = 0;
+            remaining.tv_nsec = 10000000;
+        } else if (NULL == deadline) {
+            remaining.tv_sec = 60;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        now.tv_sec += remaining.tv_sec;
+        now.tv_nsec += remaining.tv_nsec;
+        if (now.tv_nsec >= 1000000000) {
+            now.tv_sec += 1;
+            now.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        if (!aiocbs_finished(cbs, count, all))
+            pthread_cond_timedwait(&p->finished, &p->lock, &now);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    free(libc_cbs);
+    return rc;
+}
+
+static python_aiocb_object *
+build_aiocb(int fd, int nbytes, uint64_t offset, int signo, char *buffer) {
+    python_aiocb_object *pyaiocb;
+    char own_buf = NULL == buffer;
+    size_t bufsize = nbytes;
+    int k = -1;
+
+    /* an fsync has no buffer worth pooling */
+    if (own_buf && nbytes > 0 && freelist_cap > 0 &&
+            (k = size_class(nbytes)) >= 0) {
+        if (NULL != (pyaiocb = freelist[k])) {
+            freelist[k] = pyaiocb->next_done;
+            --freelist_count[k];
+            ++freelist_hits;
+            bufsize = pyaiocb->bufsize;
+            buffer = (char *)pyaiocb->cb.aio_buf;
+            /* a short read mustn't turn up the last request's bytes */
+            memset(buffer, '\0', nbytes);
+            PyObject_Init((PyObject *)pyaiocb, &python_aiocb_type);
+            goto init;
+        }
+        ++freelist_misses;
+        bufsize = (size_t)FREELIST_MIN_SIZE << k;
+    }
+
+    if (NULL == buffer && !(buffer = malloc(bufsize))) {
+        PyErr_SetString(PyExc_MemoryError, "nbytes too big, malloc failed");
+        return NULL;
+    }
+
+    if (!(pyaiocb = PyObject_New(python_aiocb_object, &python_aiocb_type)))
+        return NULL;
+
+init:
+    memset(&pyaiocb->cb, '\0', sizeof(struct aiocb));
+
+    pyaiocb->own_buf = own_buf;
+    pyaiocb->bufsize = bufsize;
+    pyaiocb->backend = BACKEND_LIBC;
+    pyaiocb->state = JOB_QUEUED;
+    pyaiocb->waiter = NULL;
+    pyaiocb->next_done = NULL;
+    pyaiocb->cb.aio_fildes = fd;
+    pyaiocb->cb.aio_nbytes = nbytes;
+    pyaiocb->cb.aio_buf = (void *)buffer;
+    pyaiocb->cb.aio_offset = offset;
+    pyaiocb->cb.aio_sigevent.sigev_notify = signo ? SIGEV_SIGNAL : SIGEV_NONE;
+    pyaiocb->cb.aio_sigevent.sigev_signo = signo;
+
+    return pyaiocb;
+}
+
+static PyObject *
+python_read_aiocb_buffer(PyObject *module, PyObject *args) {
+    python_aiocb_object *pyaiocb;
+    int nbytes = -1;
+
+    if (!PyArg_ParseTuple(args, "O!|i", &python_aiocb_type, &pyaiocb, &nbytes))
+        return NULL;
+
+    if (nbytes < 0)
+        nbytes = pyaiocb->cb.aio_nbytes;
+
+    return PyString_FromStringAndSize((const char *)pyaiocb->cb.aio_buf, nbytes);
+}
+
+static char *aio_read_kwargs[] = {"fildes", "nbytes", "offset", "signo", NULL};
+
+static PyObject *
+python_aio_read(PyObject *module, PyObject *args, PyObject *kwargs) {
+    python_aiocb_object *pyaiocb;
+    int fd, nbytes, signo = 0;
+    uint64_t offset = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|ii", aio_read_kwargs,
+                &fd, &nbytes, &offset, &signo))
+        return NULL;
+
+    if (!(pyaiocb = build_aiocb(fd, nbytes, offset, signo, NULL)))
+        return NULL;
+
+    if (submit_aiocb(pyaiocb, AIO_OP_READ)) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        Py_DECREF(pyaiocb);
+        return NULL;
+    }
+
+    return (PyObject *)pyaiocb;
+}
+
+static char *aio_write_kwargs[] = {"fildes", "data", "offset", "signo", NULL};
+
+static PyObject *
+python_aio_write(PyObject *module, PyObject *args, PyObject *kwargs) {
+    python_aiocb_object *pyaiocb;
+    char *data;
+    int fd, nbytes, signo = 0;
+    uint64_t offset = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "is#|ii", aio_write_kwargs,
+                &fd, &data, &nbytes, &offset, &signo))
+        return NULL;
+
+    if (!(pyaiocb = build_aiocb(fd, nbytes, offset, signo, data)))
+        return NULL;
+
+    if (submit_aiocb(pyaiocb, AIO_OP_WRITE)) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        Py_DECREF(pyaiocb);
+        return NULL;
+    }
+
+    return (PyObject *)pyaiocb;
+}
+
+static python_aiocb_object *
+submit_fsync(int op, int fd, int signo) {
+    python_aiocb_object *pyaiocb;
+
+    if (O_SYNC != op && O_DSYNC != op) {
+        errno = EINVAL;
+        PyErr_SetFromErrno(PyExc_IOError);
+        return NULL;
+    }
+
+    if (!(pyaiocb = build_aiocb(fd, 0, 0, signo, NULL)))
+        return NULL;
+
+    if (submit_aiocb(pyaiocb, O_DSYNC == op ? AIO_OP_DSYNC : AIO_OP_FSYNC)) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        Py_DECREF(pyaiocb);
+        return NULL;
+    }
+
+    return pyaiocb;
+}
+
+static char *aio_fsync_kwargs[] = {"op", "fildes", "signo", NULL};
+
+static PyObject *
+python_aio_fsync(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int op, fd, signo = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|i", aio_fsync_kwargs,
+            &op, &fd, &signo))
+        return NULL;
+
+    return (PyObject *)submit_fsync(op, fd, signo);
+}
+
+static PyObject *
+python_aio_error(PyObject *module, PyObject *args) {
+    python_aiocb_object *pyaiocb;
+
+    if (!PyArg_ParseTuple(args, "O!", &python_aiocb_type, &pyaiocb))
+        return NULL;
+
+    pool_release_done();
+    return PyInt_FromLong((long)aiocb_error(pyaiocb));
+}
+
+static PyObject *
+python_aio_return(PyObject *module, PyObject *args) {
+    python_aiocb_object *pyaiocb;
+    int rc;
+
+    if (!PyArg_ParseTuple(args, "O!", &python_aiocb_type, &pyaiocb))
+        return NULL;
+
+    pool_release_done();
+
+    if ((rc = aiocb_error(pyaiocb))) {
+        PyErr_SetObject(PyExc_IOError, PyInt_FromLong((long)rc));
+        return NULL;
+    }
+
+    rc = aiocb_return(pyaiocb);
+    if (rc == EINVAL) {
+        PyErr_SetObject(PyExc_IOError, PyInt_FromLong((long)EINVAL));
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)rc);
+}
+
+static PyObject *
+python_aio_cancel(PyObject *module, PyObject *args) {
+    python_aiocb_object *pyaiocb = NULL;
+    int fd, rc, pool_rc;
+
+    if (!PyArg_ParseTuple(args, "i|O", &fd, &pyaiocb))
+        return NULL;
+
+    if (Py_None == (PyObject *)pyaiocb)
+        pyaiocb = NULL;
+    else if (NULL != pyaiocb && &python_aiocb_type != Py_TYPE(pyaiocb)) {
+        PyErr_SetString(PyExc_TypeError,
+                "aiocb must be an aiocb instance or None");
+        return NULL;
+    }
+
+    if (NULL != pyaiocb && BACKEND_POOL == pyaiocb->backend)
+        return PyInt_FromLong((long)pool_cancel_job(pyaiocb));
+
+    if (0 > (rc = aio_cancel(fd, pyaiocb ? &pyaiocb->cb : NULL))) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    /* with the pool running, requests for the fd may be in either backend.
+     * any one that couldn't be canceled makes it AIO_NOTCANCELED overall */
+    if (NULL == pyaiocb && NULL != pool) {
+        pool_rc = pool_cancel_fd(fd);
+        if (AIO_NOTCANCELED == pool_rc || AIO_NOTCANCELED == rc)
+            rc = AIO_NOTCANCELED;
+        else if (AIO_CANCELED == pool_rc)
+            rc = AIO_CANCELED;
+    }
+
+    return PyInt_FromLong((long)rc);
+}
+
+static PyObject *
+python_set_freelist_size(PyObject *module, PyObject *args) {
+    Py_ssize_t cap;
+
+    if (!PyArg_ParseTuple(args, "n", &cap))
+        return NULL;
+
+    if (cap < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be non-negative");
+        return NULL;
+    }
+
+    freelist_cap = cap;
+    freelist_trim(cap);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_freelist_stats(PyObject *module, PyObject *iamnull) {
+    Py_ssize_t pooled = 0;
+    int k;
+
+    for (k = 0; k < FREELIST_CLASSES; ++k)
+        pooled += freelist_count[k];
+
+    return Py_BuildValue("{s:K,s:K,s:n,s:n}",
+            "hits", freelist_hits,
+            "misses", freelist_misses,
+            "pooled", pooled,
+            "size", freelist_cap);
+}
+
+static char *start_worker_pool_kwargs[] = {"nthreads", NULL};
+
+static PyObject *
+python_start_worker_pool(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int nthreads = 4;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i",
+                start_worker_pool_kwargs, &nthreads))
+        return NULL;
+
+    /* the asyncio adapter's pool is just put to use for everything else */
+    if (pool_running() && pool->implicit) {
+        pool->implicit = 0;
+        return PyInt_FromLong((long)pool->evfd);
+    }
+
+    if (NULL != pool) {
+        PyErr_SetString(PyExc_ValueError, "worker pool already running");
+        return NULL;
+    }
+
+    if (nthreads < 1) {
+        PyErr_SetString(PyExc_ValueError, "nthreads must be positive");
+        return NULL;
+    }
+
+    if (pool_start(nthreads)) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)pool->evfd);
+}
+
+static PyObject *
+python_stop_worker_pool(PyObject *module, PyObject *iamnull) {
+    if (!pool_running()) {
+        PyErr_SetString(PyExc_ValueError, "worker pool not running");
+        return NULL;
+    }
+
+    pool_stop();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/*
+ * aio_queue: a set of in-flight aiocbs reaped in bulk
+ */
+
+typedef struct {
+    PyObject_HEAD
+    python_aiocb_object **cbs;
+    Py_ssize_t count;
+    Py_ssize_t size;
+    unsigned PY_LONG_LONG bytes;
+} python_aioqueue_object;
+
+static PyObject *
+python_aioqueue_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_aioqueue_object *self;
+
+    if (!PyArg_ParseTuple(args, ""))
+        return NULL;
+
+    if (!(self = (python_aioqueue_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->cbs = NULL;
+    self->count = self->size = 0;
+    self->bytes = 0;
+
+    return (PyObject *)self;
+}
+
+static void
+python_aioqueue_dealloc(python_aioqueue_object *self) {
+    Py_ssize_t i;
+
+    for (i = 0; i < self->count; ++i)
+        Py_DECREF(self->cbs[i]);
+    free(self->cbs);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+python_aioqueue_length(python_aioqueue_object *self) {
+    return self->count;
+}
+
+static PyObject *
+python_aioqueue_add(python_aioqueue_object *self, PyObject *obj) {
+    python_aiocb_object **cbs;
+    Py_ssize_t size;
+
+    if (&python_aiocb_type != Py_TYPE(obj)) {
+        PyErr_SetString(PyExc_TypeError, "aiocb instance required");
+        return NULL;
+    }
+
+    if (self->count == self->size) {
+        size = self->size ? self->size * 2 : 16;
+        if (!(cbs = realloc(self->cbs, size * sizeof(*cbs))))
+            return PyErr_NoMemory();
+        self->cbs = cbs;
+        self->size = size;
+    }
+
+    Py_INCREF(obj);
+    self->cbs[self->count++] = (python_aiocb_object *)obj;
+    self->bytes += ((python_aiocb_object *)obj)->cb.aio_nbytes;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *aioqueue_reap_kwargs[] = {"max", NULL};
+
+static PyObject *
+python_aioqueue_reap(python_aioqueue_object *self, PyObject *args,
+        PyObject *kwargs) {
+    python_aiocb_object *pyaiocb;
+    Py_ssize_t i, kept = 0, max = -1;
+    PyObject *result, *pair;
+    ssize_t rc;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", aioqueue_reap_kwargs,
+                &max))
+        return NULL;
+
+    if (NULL == (result = PyList_New(0)))
+        return NULL;
+
+    pool_release_done();
+
+    for (i = 0; i < self->count; ++i) {
+        pyaiocb = self->cbs[i];
+
+        if ((max >= 0 && PyList_GET_SIZE(result) >= max) ||
+                EINPROGRESS == (err = aiocb_error(pyaiocb))) {
+            self->cbs[kept++] = pyaiocb;
+            continue;
+        }
+
+        rc = aiocb_return(pyaiocb);
+        if (err) rc = -err;
+
+        if (NULL == (pair = Py_BuildValue("(On)", pyaiocb, (Py_ssize_t)rc)) ||
+                PyList_Append(result, pair)) {
+            Py_XDECREF(pair);
+            /* the unscanned tail stays queued */
+            for (; i < self->count; ++i)
+                self->cbs[kept++] = self->cbs[i];
+            self->count = kept;
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(pair);
+
+        self->bytes -= pyaiocb->cb.aio_nbytes;
+        Py_DECREF(pyaiocb);
+    }
+    self->count = kept;
+
+    return result;
+}
+
+static PyObject *
+python_aioqueue_get_inflight(python_aioqueue_object *self, void *closure) {
+    return PyLong_FromSsize_t(self->count);
+}
+
+static PyObject *
+python_aioqueue_get_inflight_bytes(python_aioqueue_object *self,
+        void *closure) {
+    return PyLong_FromUnsignedLongLong(self->bytes);
+}
+
+static PyMethodDef aioqueue_methods[] = {
+    {"add", (PyCFunction)python_aioqueue_add, METH_O,
+        "hand an in-flight aiocb over to the queue to be reaped later\n\
+\n\
+:param aiocb aiocb:\n\
+    an aiocb returned by :func:`aio_read`, :func:`aio_write` or\n\
+    :func:`aio_fsync`\n\
+"},
+    {"reap", (PyCFunction)python_aioqueue_reap, METH_VARARGS | METH_KEYWORDS,
+        "collect finished operations\n\
+\n\
+every queued aiocb is checked in C, and the finished ones are removed from\n\
+the queue. their return values are collected in the process, so don't also\n\
+call :func:`aio_return` on them.\n\
+\n\
+:param int max:\n\
+    the maximum number of results to return (default -1 for no limit)\n\
+\n\
+:returns:\n\
+    a list of ``(aiocb, result)`` two-tuples in the order the aiocbs were\n\
+    added. ``result`` is what :func:`aio_return` would have produced, or\n\
+    ``-errno`` for a failed operation.\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef aioqueue_getset[] = {
+    {"inflight", (getter)python_aioqueue_get_inflight, NULL,
+        "the number of aiocbs in the queue", NULL},
+    {"inflight_bytes", (getter)python_aioqueue_get_inflight_bytes, NULL,
+        "total ``nbytes`` of the aiocbs in the queue", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PySequenceMethods aioqueue_as_sequence = {
+    (lenfunc)python_aioqueue_length,           /* sq_length */
+};
+
+static PyTypeObject python_aioqueue_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_aio.aio_queue",             /* tp_name */
+    sizeof(python_aioqueue_object),            /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_aioqueue_dealloc,       /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &aioqueue_as_sequence,                     /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "a set of in-flight aiocbs that can be reaped in bulk",  /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    aioqueue_methods,                          /* tp_methods */
+    0,                                         /* tp_members */
+    aioqueue_getset,                           /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_aioqueue_new,                       /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+
+/*
+ * aio_group: a batch of requests that completes when all of them do
+ */
+
 typedef struct {
     PyObject_HEAD
-    char own_buf;
-    struct aiocb cb;
-} python_aiocb_object;
+    Py_ssize_t count;
+    python_aiocb_object **cbs;
+} python_aiogroup_object;
 
 static void
-python_aiocb_dealloc(python_aiocb_object *self) {
-    if (self->own_buf) free((void *)self->cb.aio_buf);
+python_aiogroup_dealloc(python_aiogroup_object *self) {
+    Py_ssize_t i;
+
+    for (i = 0; i < self->count; ++i)
+        Py_DECREF(self->cbs[i]);
+    free(self->cbs);
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
-static PyTypeObject python_aiocb_type = {
+static Py_ssize_t
+python_aiogroup_length(python_aiogroup_object *self) {
+    return self->count;
+}
+
+static PyObject *
+python_aiogroup_done(python_aiogroup_object *self, PyObject *iamnull) {
+    pool_release_done();
+    return PyBool_FromLong(aiocbs_finished(self->cbs, self->count, 1));
+}
+
+static char *aiogroup_wait_kwargs[] = {"timeout", NULL};
+
+static PyObject *
+python_aiogroup_wait(python_aiogroup_object *self, PyObject *args,
+        PyObject *kwargs) {
+    PyObject *pytimeout = Py_None;
+    struct timespec timeout, deadline;
+    struct timespec *timeoutp = &timeout;
+    worker_pool *p;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", aiogroup_wait_kwargs,
+                &pytimeout))
+        return NULL;
+
+    switch (timespec_ify(pytimeout, timeoutp)) {
+        case -1:
+            return NULL;
+        case 1:
+            timeoutp = NULL;
+    }
+    timeoutp = deadline_ify(timeoutp, &deadline);
+
+    for (;;) {
+        p = pool_ref();
+        Py_BEGIN_ALLOW_THREADS
+        rc = wait_aiocbs(p, self->cbs, self->count, 1, timeoutp);
+        Py_END_ALLOW_THREADS
+        pool_unref(p);
+
+        pool_release_done();
+
+        if (rc < 0 && EINTR == errno) {
+            if (PyErr_CheckSignals()) return NULL;
+            continue;
+        }
+        break;
+    }
+
+    if (rc < 0 && EAGAIN != errno) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyBool_FromLong(!rc);
+}
+
+static PyObject *
+python_aiogroup_results(python_aiogroup_object *self, PyObject *iamnull) {
+    PyObject *result, *item;
+    Py_ssize_t i;
+    ssize_t rc;
+    int err;
+
+    pool_release_done();
+
+    if (!aiocbs_finished(self->cbs, self->count, 1)) {
+        PyErr_SetObject(PyExc_IOError, PyInt_FromLong((long)EINPROGRESS));
+        return NULL;
+    }
+
+    if (NULL == (result = PyList_New(self->count)))
+        return NULL;
+
+    for (i = 0; i < self->count; ++i) {
+        err = aiocb_error(self->cbs[i]);
+        rc = aiocb_return(self->cbs[i]);
+        if (NULL == (item = PyInt_FromLong(err ? -(long)err : (long)rc))) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return result;
+}
+
+static PyMethodDef aiogroup_methods[] = {
+    {"done", (PyCFunction)python_aiogroup_done, METH_NOARGS,
+        "check whether every request in the group has finished\n\
+\n\
+:returns: bool\n\
+"},
+    {"wait", (PyCFunction)python_aiogroup_wait, METH_VARARGS | METH_KEYWORDS,
+        "block until every request in the group has finished\n\
+\n\
+:param timeout:\n\
+    maximum time to wait (default None for unlimited)\n\
+:type timeout: int, float or None\n\
+\n\
+:returns: ``True`` if the group finished, ``False`` if the timeout expired\n\
+"},
+    {"results", (PyCFunction)python_aiogroup_results, METH_NOARGS,
+        "collect the results of a finished group\n\
+\n\
+:returns:\n\
+    a list with the :func:`aio_return` value of each request (in the order\n\
+    they were submitted), or ``-errno`` for each that failed\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods aiogroup_as_sequence = {
+    (lenfunc)python_aiogroup_length,           /* sq_length */
+};
+
+static PyTypeObject python_aiogroup_type = {
     PyObject_HEAD_INIT(&PyType_Type)
 #if PY_MAJOR_VERSION < 3
     0,                                         /* ob_size */
 #endif
-    "penguin.posix_aio.aiocb",                 /* tp_name */
-    sizeof(python_aiocb_object),               /* tp_basicsize */
+    "penguin.posix_aio.aio_group",             /* tp_name */
+    sizeof(python_aiogroup_object),            /* tp_basicsize */
     0,                                         /* tp_itemsize */
-    (destructor)python_aiocb_dealloc,          /* tp_dealloc */
+    (destructor)python_aiogroup_dealloc,       /* tp_dealloc */
     0,                                         /* tp_print */
     0,                                         /* tp_getattr */
     0,                                         /* tp_setattr */
     0,                                         /* tp_compare */
     0,                                         /* tp_repr */
     0,                                         /* tp_as_number */
-    0,                                         /* tp_as_sequence */
+    &aiogroup_as_sequence,                     /* tp_as_sequence */
     0,                                         /* tp_as_mapping */
     0,                                         /* tp_hash */
     0,                                         /* tp_call */
@@ -41,14 +1435,14 @@ static PyTypeObject python_aiocb_type = {
     0,                                         /* tp_setattro */
     0,                                         /* tp_as_buffer */
     Py_TPFLAGS_DEFAULT,                        /* tp_flags */
-    0,                                         /* tp_doc */
+    "a batch of aio requests that completes when they all do", /* tp_doc */
     0,                                         /* tp_traverse */
     0,                                         /* tp_clear */
     0,                                         /* tp_richcompare */
     0,                                         /* tp_weaklistoffset */
     0,                                         /* tp_iter */
     0,                                         /* tp_iternext */
-    0,                                         /* tp_methods */
+    aiogroup_methods,                          /* tp_methods */
     0,                                         /* tp_members */
     0,                                         /* tp_getset */
     0,                                         /* tp_base */
@@ -58,178 +1452,437 @@ static PyTypeObject python_aiocb_type = {
     0,                                         /* tp_dictoffset */
     0,                                         /* tp_init */
     PyType_GenericAlloc,                       /* tp_alloc */
-    PyType_GenericNew,                         /* tp_new */
+    0,                                         /* tp_new */
     PyObject_Del,                              /* tp_free */
 };
 
-static python_aiocb_object *
-build_aiocb(int fd, int nbytes, uint64_t offset, int signo, char *buffer) {
-    python_aiocb_object *pyaiocb;
-    char own_buf = NULL == buffer;
+/*
+ * wait out requests that are being abandoned, with an exception already set.
+ * returns -1 if they might still be in flight.
+ */
+static int
+drain_aiocbs(python_aiocb_object **cbs, Py_ssize_t count) {
+    worker_pool *p;
+    int rc;
 
-    if (NULL == buffer && !(buffer = malloc(nbytes))) {
-        PyErr_SetString(PyExc_MemoryError, "nbytes too big, malloc failed");
-        return NULL;
-    }
+    p = pool_ref();
+    Py_BEGIN_ALLOW_THREADS
+    do {
+        rc = wait_aiocbs(p, cbs, count, 1, NULL);
+    } while (rc < 0 && EINTR == errno);
+    Py_END_ALLOW_THREADS
+    pool_unref(p);
 
-    if (!(pyaiocb = PyObject_New(python_aiocb_object, &python_aiocb_type)))
-        return NULL;
+    pool_release_done();
+    return rc;
+}
 
-    memset(&pyaiocb->cb, '\0', sizeof(struct aiocb));
+static char *aio_fsync_many_kwargs[] = {"fds", "op", "signo", NULL};
 
-    pyaiocb->own_buf = own_buf;
-    pyaiocb->cb.aio_fildes = fd;
-    pyaiocb->cb.aio_nbytes = nbytes;
-    pyaiocb->cb.aio_buf = (void *)buffer;
-    pyaiocb->cb.aio_offset = offset;
-    pyaiocb->cb.aio_sigevent.sigev_notify = signo ? SIGEV_SIGNAL : SIGEV_NONE;
-    pyaiocb->cb.aio_sigevent.sigev_signo = signo;
+static PyObject *
+python_aio_fsync_many(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *pyfds, *seq;
+    python_aiogroup_object *group;
+    Py_ssize_t i, count;
+    int fd, op = O_SYNC, signo = 0;
 
-    return pyaiocb;
-}
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii",
+                aio_fsync_many_kwargs, &pyfds, &op, &signo))
+        return NULL;
 
-static PyObject *
-python_read_aiocb_buffer(PyObject *module, PyObject *args) {
-    python_aiocb_object *pyaiocb;
-    int nbytes = -1;
+    if (NULL == (seq = PySequence_Fast(pyfds, "fds must be iterable")))
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
 
-    if (!PyArg_ParseTuple(args, "O!|i", &python_aiocb_type, &pyaiocb, &nbytes))
+    if (!(group = PyObject_New(python_aiogroup_object,
+                    &python_aiogroup_type))) {
+        Py_DECREF(seq);
         return NULL;
+    }
+    group->count = 0;
+    if (!(group->cbs = malloc((count ? count : 1) * sizeof(*group->cbs)))) {
+        Py_DECREF(seq);
+        Py_DECREF(group);
+        return PyErr_NoMemory();
+    }
 
-    if (nbytes < 0)
-        nbytes = pyaiocb->cb.aio_nbytes;
+    for (i = 0; i < count; ++i) {
+        fd = (int)PyInt_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if ((-1 == fd && PyErr_Occurred()) ||
+                !(group->cbs[i] = submit_fsync(op, fd, signo))) {
+            /* the syncs already submitted can't be freed under glibc or
+             * the pool, so see them through before dropping the group */
+            if (drain_aiocbs(group->cbs, group->count) < 0)
+                group->count = 0; /* leaked rather than freed in flight */
+            Py_DECREF(seq);
+            Py_DECREF(group);
+            return NULL;
+        }
+        group->count = i + 1;
+    }
 
-    return PyString_FromStringAndSize((const char *)pyaiocb->cb.aio_buf, nbytes);
+    Py_DECREF(seq);
+    return (PyObject *)group;
 }
 
-static char *aio_read_kwargs[] = {"fildes", "nbytes", "offset", "signo", NULL};
+static char *aio_suspend_kwargs[] = {"aiocbs", "timeout", NULL};
 
 static PyObject *
-python_aio_read(PyObject *module, PyObject *args, PyObject *kwargs) {
-    python_aiocb_object *pyaiocb;
-    int fd, nbytes, signo = 0;
-    uint64_t offset = 0;
+python_aio_suspend(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *pycbs, *seq, *item, *pytimeout = Py_None;
+    python_aiocb_object **cbs;
+    struct timespec timeout, deadline;
+    struct timespec *timeoutp = &timeout;
+    Py_ssize_t i, count;
+    worker_pool *p;
+    int rc;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|ii", aio_read_kwargs,
-                &fd, &nbytes, &offset, &signo))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", aio_suspend_kwargs,
+                &pycbs, &pytimeout))
         return NULL;
 
-    if (!(pyaiocb = build_aiocb(fd, nbytes, offset, signo, NULL)))
+    switch (timespec_ify(pytimeout, timeoutp)) {
+        case -1:
+            return NULL;
+        case 1:
+            timeoutp = NULL;
+    }
+
+    if (NULL == (seq = PySequence_Fast(pycbs, "aiocbs must be iterable")))
         return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
 
-    if (aio_read(&pyaiocb->cb)) {
-        PyErr_SetFromErrno(PyExc_IOError);
-        Py_DECREF(pyaiocb);
+    if (!(cbs = malloc((count ? count : 1) * sizeof(*cbs)))) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (&python_aiocb_type != Py_TYPE(item)) {
+            PyErr_SetString(PyExc_TypeError, "aiocb instances required");
+            free(cbs);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        cbs[i] = (python_aiocb_object *)item;
+    }
+
+    timeoutp = deadline_ify(timeoutp, &deadline);
+
+    for (;;) {
+        p = pool_ref();
+        Py_BEGIN_ALLOW_THREADS
+        rc = wait_aiocbs(p, cbs, count, 0, timeoutp);
+        Py_END_ALLOW_THREADS
+        pool_unref(p);
+
+        pool_release_done();
+
+        if (rc < 0 && EINTR == errno) {
+            if (PyErr_CheckSignals()) {
+                free(cbs);
+                Py_DECREF(seq);
+                return NULL;
+            }
+            continue;
+        }
+        break;
+    }
+
+    free(cbs);
+    Py_DECREF(seq);
+
+    if (rc < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
-    return (PyObject *)pyaiocb;
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
-static char *aio_write_kwargs[] = {"fildes", "data", "offset", "signo", NULL};
+
+/*
+ * asyncio adapter
+ *
+ * requests made through read(), write() and fsync() go to the worker pool
+ * with a future attached. if the pool isn't running the first of them starts
+ * it, but only for their own use: aio_read() and co. stay on glibc until
+ * start_worker_pool() is called. the pool's eventfd is registered as a reader on the
+ * running event loop, and each time it fires every finished future is
+ * resolved in one pass.
+ *
+ * there's only the one eventfd, so only one loop can be fed at a time. it
+ * moves to whichever loop asks next, but not while futures created on the
+ * current one are outstanding, since they could never be resolved. a closed
+ * loop has given up on its futures, so it doesn't hold on to the eventfd.
+ */
+
+static PyObject *get_running_loop = NULL;
+static PyObject *registered_loop = NULL;
+static PyObject *dispatch_callback = NULL;
+static long waiting = 0;
+
+static void
+resolve_waiter(python_aiocb_object *job) {
+    PyObject *done, *value, *rc;
+    const char *method = "set_result";
+
+    if (NULL == (done = PyObject_CallMethod(job->waiter, "done", NULL)))
+        goto fail;
+    if (PyObject_IsTrue(done)) {
+        /* the future was cancelled, nobody wants the result */
+        Py_DECREF(done);
+        return;
+    }
+    Py_DECREF(done);
+
+    if (job->error) {
+        method = "set_exception";
+        value = PyObject_CallFunction(PyExc_OSError, "is", job->error,
+                strerror(job->error));
+    } else if (AIO_OP_READ == job->op)
+        value = PyString_FromStringAndSize(
+                (const char *)job->cb.aio_buf, job->result);
+    else
+        value = PyInt_FromLong((long)job->result);
+
+    if (NULL == value)
+        goto fail;
+
+    rc = PyObject_CallMethod(job->waiter, (char *)method, "O", value);
+    Py_DECREF(value);
+    if (NULL == rc)
+        goto fail;
+    Py_DECREF(rc);
+    return;
+
+fail:
+    PyErr_WriteUnraisable(job->waiter);
+}
+
+/* settle the futures of every finished request. the GIL must be held */
+static void
+pool_resolve_waiters(void) {
+    python_aiocb_object *job, *next;
+
+    pthread_mutex_lock(&pool->lock);
+    job = pool->resolved;
+    pool->resolved = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (; NULL != job; job = next) {
+        next = job->next_done;
+        --waiting;
+        resolve_waiter(job);
+        Py_CLEAR(job->waiter);
+        Py_DECREF(job);
+    }
+}
 
 static PyObject *
-python_aio_write(PyObject *module, PyObject *args, PyObject *kwargs) {
-    python_aiocb_object *pyaiocb;
-    char *data;
-    int fd, nbytes, signo = 0;
-    uint64_t offset = 0;
+python_dispatch(PyObject *module, PyObject *iamnull) {
+    eventfd_t count;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "is#|ii", aio_write_kwargs,
-                &fd, &data, &nbytes, &offset, &signo))
+    if (NULL != pool) {
+        eventfd_read(pool->evfd, &count);
+        pool_resolve_waiters();
+        pool_release_done();
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyMethodDef dispatch_def = {
+    "_dispatch", python_dispatch, METH_NOARGS, NULL};
+
+static void
+unregister_loop(void) {
+    PyObject *rc;
+
+    if (NULL == registered_loop) return;
+
+    rc = PyObject_CallMethod(registered_loop, "remove_reader", "i",
+            pool->evfd);
+    if (NULL == rc)
+        PyErr_Clear();
+    Py_XDECREF(rc);
+    Py_CLEAR(registered_loop);
+}
+
+/* true if the loop is gone, and won't be resolving its futures any more */
+static int
+loop_is_closed(PyObject *loop) {
+    PyObject *closed;
+    int rc;
+
+    if (NULL == loop) return 1;
+    if (NULL == (closed = PyObject_CallMethod(loop, "is_closed", NULL))) {
+        PyErr_Clear();
+        return 0;
+    }
+    rc = PyObject_IsTrue(closed);
+    Py_DECREF(closed);
+    return rc > 0;
+}
+
+/* make sure the pool is running and feeding the current event loop */
+static PyObject *
+running_loop(void) {
+    PyObject *asyncio, *loop, *rc;
+
+    if (NULL == get_running_loop) {
+        if (NULL == (asyncio = PyImport_ImportModule("asyncio")))
+            return NULL;
+        get_running_loop = PyObject_GetAttrString(asyncio, "get_running_loop");
+        Py_DECREF(asyncio);
+        if (NULL == get_running_loop)
+            return NULL;
+    }
+
+    if (NULL == dispatch_callback &&
+            NULL == (dispatch_callback = PyCFunction_New(&dispatch_def, NULL)))
         return NULL;
 
-    if (!(pyaiocb = build_aiocb(fd, nbytes, offset, signo, data)))
+    if (NULL == (loop = PyObject_CallObject(get_running_loop, NULL)))
         return NULL;
 
-    if (aio_write(&pyaiocb->cb)) {
-        PyErr_SetFromErrno(PyExc_IOError);
-        Py_DECREF(pyaiocb);
+    if (NULL != pool && pool->stopping) {
+        Py_DECREF(loop);
+        PyErr_SetString(PyExc_ValueError, "worker pool is stopping");
         return NULL;
     }
 
-    return (PyObject *)pyaiocb;
-}
+    if (NULL == pool) {
+        if (pool_start(4)) {
+            Py_DECREF(loop);
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        pool->implicit = 1;
+    }
+
+    if (loop != registered_loop) {
+        if (waiting && !loop_is_closed(registered_loop)) {
+            Py_DECREF(loop);
+            PyErr_SetString(PyExc_RuntimeError,
+                    "requests from another event loop are still pending");
+            return NULL;
+        }
+        unregister_loop();
+        rc = PyObject_CallMethod(loop, "add_reader", "iO", pool->evfd,
+                dispatch_callback);
+        if (NULL == rc) {
+            Py_DECREF(loop);
+            return NULL;
+        }
+        Py_DECREF(rc);
+        Py_INCREF(loop);
+        registered_loop = loop;
+    }
 
-static char *aio_fsync_kwargs[] = {"op", "fildes, signo", NULL};
+    return loop;
+}
 
 static PyObject *
-python_aio_fsync(PyObject *module, PyObject *args, PyObject *kwargs) {
-    int op, fd, signo = 0;
-    python_aiocb_object *pyaiocb;
+submit_with_future(python_aiocb_object *pyaiocb, int op) {
+    PyObject *loop, *future;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|i", aio_fsync_kwargs,
-            &op, &fd, &signo))
+    if (NULL == (loop = running_loop())) {
+        Py_DECREF(pyaiocb);
         return NULL;
+    }
 
-    if (!(pyaiocb = build_aiocb(fd, 0, 0, signo, NULL)))
+    future = PyObject_CallMethod(loop, "create_future", NULL);
+    Py_DECREF(loop);
+    if (NULL == future) {
+        Py_DECREF(pyaiocb);
         return NULL;
+    }
 
-    if (aio_fsync(op, &pyaiocb->cb)) {
+    Py_INCREF(future);
+    pyaiocb->waiter = future;
+
+    /* straight to the pool, whether or not it's serving the aio_* calls */
+    pyaiocb->op = op;
+    if (pool_submit(pyaiocb)) {
         PyErr_SetFromErrno(PyExc_IOError);
+        Py_DECREF(future);
         Py_DECREF(pyaiocb);
         return NULL;
     }
+    ++waiting;
 
     Py_DECREF(pyaiocb);
-    Py_INCREF(Py_None);
-    return Py_None;
+    return future;
 }
 
+static char *async_read_kwargs[] = {"fildes", "nbytes", "offset", NULL};
+
 static PyObject *
-python_aio_error(PyObject *module, PyObject *args) {
+python_async_read(PyObject *module, PyObject *args, PyObject *kwargs) {
     python_aiocb_object *pyaiocb;
+    int fd, nbytes;
+    PY_LONG_LONG offset = 0;
 
-    if (!PyArg_ParseTuple(args, "O!", &python_aiocb_type, &pyaiocb))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|L", async_read_kwargs,
+                &fd, &nbytes, &offset))
+        return NULL;
+
+    if (!(pyaiocb = build_aiocb(fd, nbytes, offset, 0, NULL)))
         return NULL;
 
-    return PyInt_FromLong((long)aio_error(&pyaiocb->cb));
+    return submit_with_future(pyaiocb, AIO_OP_READ);
 }
 
+static char *async_write_kwargs[] = {"fildes", "data", "offset", NULL};
+
 static PyObject *
-python_aio_return(PyObject *module, PyObject *args) {
+python_async_write(PyObject *module, PyObject *args, PyObject *kwargs) {
     python_aiocb_object *pyaiocb;
-    int rc;
-
-    if (!PyArg_ParseTuple(args, "O!", &python_aiocb_type, &pyaiocb))
-        return NULL;
+    Py_buffer data;
+    int fd;
+    PY_LONG_LONG offset = 0;
 
-    if ((rc = aio_error(&pyaiocb->cb))) {
-        PyErr_SetObject(PyExc_IOError, PyInt_FromLong((long)rc));
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "is*|L", async_write_kwargs,
+                &fd, &data, &offset))
         return NULL;
-    }
 
-    rc = aio_return(&pyaiocb->cb);
-    if (rc == EINVAL) {
-        PyErr_SetObject(PyExc_IOError, PyInt_FromLong((long)EINVAL));
+    /* the data is copied, the request may outlive the caller's buffer */
+    if (!(pyaiocb = build_aiocb(fd, data.len, offset, 0, NULL))) {
+        PyBuffer_Release(&data);
         return NULL;
     }
+    memcpy((void *)pyaiocb->cb.aio_buf, data.buf, data.len);
+    PyBuffer_Release(&data);
 
-    return PyInt_FromLong((long)rc);
+    return submit_with_future(pyaiocb, AIO_OP_WRITE);
 }
 
+static char *async_fsync_kwargs[] = {"fildes", "op", NULL};
+
 static PyObject *
-python_aio_cancel(PyObject *module, PyObject *args) {
-    python_aiocb_object *pyaiocb = NULL;
-    int fd, rc;
+python_async_fsync(PyObject *module, PyObject *args, PyObject *kwargs) {
+    python_aiocb_object *pyaiocb;
+    int fd, op = O_SYNC;
 
-    if (!PyArg_ParseTuple(args, "i|O", &fd, &pyaiocb))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|i", async_fsync_kwargs,
+                &fd, &op))
         return NULL;
 
-    if (Py_None == (PyObject *)pyaiocb)
-        pyaiocb = NULL;
-    else if (&python_aiocb_type != Py_TYPE(pyaiocb)) {
-        PyErr_SetString(PyExc_TypeError,
-                "aiocb must be an aiocb instance or None");
+    if (O_SYNC != op && O_DSYNC != op) {
+        errno = EINVAL;
+        PyErr_SetFromErrno(PyExc_IOError);
         return NULL;
     }
 
-    if (0 > (rc = aio_cancel(fd, pyaiocb ? &pyaiocb->cb : NULL))) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    if (!(pyaiocb = build_aiocb(fd, 0, 0, 0, NULL)))
         return NULL;
-    }
 
-    return PyInt_FromLong((long)rc);
+    return submit_with_future(pyaiocb,
+            O_DSYNC == op ? AIO_OP_DSYNC : AIO_OP_FSYNC);
 }
 #endif
 
@@ -290,7 +1943,42 @@ static PyMethodDef methods[] = {
 :type fildes: int\n\
 \n\
 :param signo: signal to send when the fsync completes (default 0 for none)\n\
-:type signo: int"},
+:type signo: int\n\
+\n\
+:returns: an aiocb, which can be used to wait for the fsync's completion"},
+    {"aio_fsync_many", (PyCFunction)python_aio_fsync_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "queue fsync requests for many file descriptors at once\n\
+\n\
+:param fds: file descriptors to sync\n\
+:type fds: iterable of ints\n\
+\n\
+:param int op:\n\
+    ``O_SYNC`` (the default) to behave like fsync(2), or ``O_DSYNC`` to behave\n\
+    like fdatasync(2)\n\
+\n\
+:param int signo:\n\
+    signal to send as each individual fsync completes (default 0 for none)\n\
+\n\
+:returns:\n\
+    an ``aio_group`` which is done once all of the syncs are. it has methods\n\
+    ``done()``, ``wait(timeout=None)`` and ``results()``.\n\
+"},
+    {"aio_suspend", (PyCFunction)python_aio_suspend,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait for at least one of a list of aio operations to complete\n\
+\n\
+this works on aiocbs from either the glibc backend or the worker pool. see\n\
+the aio_suspend(3) man page for more details.\n\
+\n\
+:param aiocbs: the aiocbs to wait on\n\
+:type aiocbs: iterable of aiocbs\n\
+\n\
+:param timeout:\n\
+    maximum time to wait, after which ``OSError`` is raised with ``EAGAIN``\n\
+    (default None for unlimited)\n\
+:type timeout: int, float or None\n\
+"},
     {"aio_error", python_aio_error, METH_VARARGS,
         "get the error status of an aio operation\n\
 \n\
@@ -317,6 +2005,109 @@ static PyMethodDef methods[] = {
 :type aiocb: aiocb\n\
 \n\
 :returns: one of the constants AIO_CANCELED, AIO_NOTCANCELED, or AIO_ALLDONE"},
+    {"read", (PyCFunction)python_async_read, METH_VARARGS | METH_KEYWORDS,
+        "asyncio-friendly read from a file descriptor\n\
+\n\
+the read is handed to the worker pool, and the pool's eventfd is registered\n\
+as a reader on the running event loop. if :func:`start_worker_pool` hasn't\n\
+been called, the first of these asyncio functions starts the pool with 4\n\
+threads for their use alone: :func:`aio_read`, :func:`aio_write` and\n\
+:func:`aio_fsync` go on using glibc. completed requests have their futures\n\
+resolved in batches whenever the eventfd fires, so don't read from it\n\
+yourself while using these functions.\n\
+\n\
+must be called with an asyncio event loop running in the current thread.\n\
+only one loop at a time can be served: calling this from a different loop\n\
+while futures from the last one are still pending raises ``RuntimeError``,\n\
+unless that loop has been closed.\n\
+\n\
+:param int fildes: file descriptor to read from\n\
+\n\
+:param int nbytes: maximum number of bytes to read\n\
+\n\
+:param int offset: offset of the file to start the read from (default 0)\n\
+\n\
+:returns:\n\
+    an asyncio future which will resolve to the string read, or be failed\n\
+    with an ``OSError``\n\
+"},
+    {"write", (PyCFunction)python_async_write, METH_VARARGS | METH_KEYWORDS,
+        "asyncio-friendly write to a file descriptor\n\
+\n\
+see :func:`read` for how requests are run and completed. ``data`` is copied,\n\
+so the caller's buffer may be reused immediately.\n\
+\n\
+:param int fildes: file descriptor to write to\n\
+\n\
+:param str data: the data to write into the file descriptor\n\
+\n\
+:param int offset: offset of the file to start the write from (default 0)\n\
+\n\
+:returns:\n\
+    an asyncio future which will resolve to the number of bytes written, or\n\
+    be failed with an ``OSError``\n\
+"},
+    {"fsync", (PyCFunction)python_async_fsync, METH_VARARGS | METH_KEYWORDS,
+        "asyncio-friendly fsync of a file descriptor\n\
+\n\
+see :func:`read` for how requests are run and completed.\n\
+\n\
+:param int fildes: file descriptor to sync\n\
+\n\
+:param int op:\n\
+    ``O_SYNC`` (the default) to behave like fsync(2), or ``O_DSYNC`` to behave\n\
+    like fdatasync(2)\n\
+\n\
+:returns:\n\
+    an asyncio future which will resolve to 0, or be failed with an\n\
+    ``OSError``\n\
+"},
+    {"set_freelist_size", python_set_freelist_size, METH_VARARGS,
+        "set how many dead aiocbs to keep for reuse, per buffer size class\n\
+\n\
+with a positive size, :func:`aio_read` rounds its buffer up to a power of 2\n\
+(512 bytes to 1MB, larger reads aren't pooled) and garbage aiocbs are kept\n\
+along with their buffers to serve later reads of the same size class,\n\
+rather than freed. the default of 0 disables the free lists.\n\
+\n\
+:param int size: the maximum number of aiocbs to keep in each size class\n\
+"},
+    {"freelist_stats", python_freelist_stats, METH_NOARGS,
+        "get counters describing the aiocb free lists\n\
+\n\
+:returns:\n\
+    a dict with the keys ``hits`` and ``misses`` (how many pooled-mode aiocb\n\
+    allocations were served from the free lists or not), ``pooled`` (how\n\
+    many aiocbs are currently held for reuse) and ``size`` (the current cap\n\
+    set by :func:`set_freelist_size`)\n\
+"},
+    {"start_worker_pool", (PyCFunction)python_start_worker_pool,
+        METH_VARARGS | METH_KEYWORDS,
+        "switch to the in-extension thread pool backend\n\
+\n\
+glibc runs the requests for any single file descriptor one at a time. once\n\
+this is called, :func:`aio_read`, :func:`aio_write` and :func:`aio_fsync`\n\
+instead hand their requests to a work-stealing pool of threads running\n\
+pread(2), pwrite(2), fsync(2) and fdatasync(2), so requests against the same\n\
+file proceed concurrently. :func:`aio_error`, :func:`aio_return` and\n\
+:func:`aio_cancel` work the same on either kind of aiocb, though the pool can\n\
+only cancel requests that haven't been picked up by a thread yet.\n\
+\n\
+if the asyncio functions (:func:`read` and co.) already started the pool,\n\
+that pool is put to use as it is and ``nthreads`` is ignored.\n\
+\n\
+:param int nthreads: the number of worker threads to run (default 4)\n\
+\n\
+:returns:\n\
+    an integer non-blocking eventfd that is added to each time a request\n\
+    completes. this is in addition to any ``signo`` notification.\n\
+"},
+    {"stop_worker_pool", python_stop_worker_pool, METH_NOARGS,
+        "shut down the worker pool and go back to glibc's aio implementation\n\
+\n\
+this blocks until every request already handed to the pool has completed,\n\
+then closes the pool's eventfd.\n\
+"},
 #endif
 
     {NULL, NULL, 0, NULL}
@@ -334,6 +2125,8 @@ PyMODINIT_FUNC
 PyInit_posix_aio(void) {
     PyObject *module;
     if (PyType_Ready(&python_aiocb_type)) return NULL;
+    if (PyType_Ready(&python_aioqueue_type)) return NULL;
+    if (PyType_Ready(&python_aiogroup_type)) return NULL;
     module = PyModule_Create(&posix_aio_module);
 
 #else
@@ -342,10 +2135,17 @@ PyMODINIT_FUNC
 initposix_aio(void) {
     PyObject *module;
     if (PyType_Ready(&python_aiocb_type)) return;
+    if (PyType_Ready(&python_aioqueue_type)) return;
+    if (PyType_Ready(&python_aiogroup_type)) return;
     module = Py_InitModule("penguin.posix_aio", methods);
 
 #endif
 
+    Py_INCREF(&python_aioqueue_type);
+    PyModule_AddObject(module, "aio_queue", (PyObject *)&python_aioqueue_type);
+    Py_INCREF(&python_aiogroup_type);
+    PyModule_AddObject(module, "aio_group", (PyObject *)&python_aiogroup_type);
+
 #ifdef AIO_CANCELED
     PyModule_AddIntConstant(module, "AIO_CANCELED", AIO_CANCELED);
 #endif
@@ -355,6 +2155,12 @@ initposix_aio(void) {
 #ifdef AIO_ALLDONE
     PyModule_AddIntConstant(module, "AIO_ALLDONE", AIO_ALLDONE);
 #endif
+#ifdef O_SYNC
+    PyModule_AddIntConstant(module, "O_SYNC", O_SYNC);
+#endif
+#ifdef O_DSYNC
+    PyModule_AddIntConstant(module, "O_DSYNC", O_DSYNC);
+#endif
 
 #if PY_MAJOR_VERSION >= 3
     return module;
@@ -1,35 +1,49 @@
 #include "src/common.h"
+#include "src/structseq.h"
 
 #include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <mqueue.h>
+#include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <time.h>
+#include <unistd.h>
 
-static PyObject *py_mq_attr = NULL;
-static PyObject *sysv_shm = NULL;
-static PyObject *mmap_type = NULL;
-
+/* sem_clockwait and the pthread clocklock functions arrived in glibc 2.30 */
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || \
+        (__GLIBC__ == 2 && __GLIBC_MINOR__ < 30)
+#define SEM_CLOCKWAIT_MISSING
+#define PTHREAD_CLOCKLOCK_MISSING
+#endif
 
-static long msgsize_max;
-#define MSGSIZE_MAX msgsize_max > 0 ? msgsize_max : 8192
+/* futex_waitv arrived in linux 5.16 */
+#if !defined(SYS_futex_waitv) || !defined(FUTEX_WAITV_MAX)
+#define FUTEX_WAITV_MISSING
+#endif
 
-static void
-get_msgsizemax(void) {
-    FILE *fp;
-    char buf[4096], *ptr = &buf[0];
-    size_t len;
+static PyStructSequence_Field mq_attr_fields[] = {
+    {"mq_flags", NULL}, {"mq_maxmsg", NULL}, {"mq_msgsize", NULL},
+    {"mq_curmsgs", NULL}, {NULL}
+};
+static PyStructSequence_Desc mq_attr_desc = {
+    "penguin.posix_ipc.mq_attr", "message queue attributes",
+    mq_attr_fields, 4
+};
+static PyTypeObject mq_attr_type;
+static int mq_attr_ready = 0;
 
-    if (NULL == (fp = fopen("/proc/sys/fs/mqueue/msgsize_max", "r"))) {
-        msgsize_max = -1;
-        return;
-    }
+static PyObject *sysv_shm = NULL;
+static PyObject *mmap_type = NULL;
 
-    len = fread(ptr, 1, 4095, fp);
-    ptr[len] = 0;
-    msgsize_max = strtol(ptr, NULL, 10);
-}
 
 static int
 pytolong(PyObject *obj, long *target) {
@@ -47,14 +61,54 @@ pytolong(PyObject *obj, long *target) {
 }
 
 static int
-abs_timespec_ify(double secs, struct timespec *result) {
-    if (clock_gettime(CLOCK_REALTIME, result) < 0)
+clock_timespec_ify(clockid_t clock, double secs, struct timespec *result) {
+    if (clock_gettime(clock, result) < 0)
         return -1;
     result->tv_sec += (time_t)secs;
     result->tv_nsec += (long)((secs - (long)secs) * 1E9);
+    if (result->tv_nsec >= 1000000000) {
+        result->tv_sec++;
+        result->tv_nsec -= 1000000000;
+    }
+    return 0;
+}
+
+static int
+abs_timespec_ify(double secs, struct timespec *result) {
+    return clock_timespec_ify(CLOCK_REALTIME, secs, result);
+}
+
+
+/*
+ * futexes
+ *
+ * these are always the shared (not FUTEX_PRIVATE_FLAG) kind, as the words
+ * live in memory mapped into several processes. waits take an absolute
+ * CLOCK_MONOTONIC deadline so a retry after a spurious wakeup doesn't
+ * restart the clock.
+ */
+
+/* 0 when woken or the word no longer holds expected, 1 on timeout, -1 with
+ * errno set. called without the GIL. */
+static int
+futex_wait_word(uint32_t *word, uint32_t expected,
+        const struct timespec *deadline) {
+    if (syscall(SYS_futex, word, FUTEX_WAIT_BITSET, expected, deadline,
+                NULL, FUTEX_BITSET_MATCH_ANY) < 0) {
+        if (EAGAIN == errno)
+            return 0;
+        if (ETIMEDOUT == errno)
+            return 1;
+        return -1;
+    }
     return 0;
 }
 
+static int
+futex_wake_word(uint32_t *word, int count) {
+    return (int)syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
 static int
 parse_mqattr(PyObject *objs, struct mq_attr *attrp) {
     if (!PyTuple_Check(objs) || PyObject_Length(objs) != 4) {
@@ -73,32 +127,32 @@ parse_mqattr(PyObject *objs, struct mq_attr *attrp) {
 
 static PyObject *
 dump_mqattr(struct mq_attr *attrp) {
-    PyObject *args, *obj, *result = NULL;
+    PyObject *result, *obj;
 
-    if (NULL == (args = PyTuple_New(4)))
+    if (NULL == (result = PyStructSequence_New(&mq_attr_type)))
         return NULL;
 
     if (NULL == (obj = PyInt_FromLong(attrp->mq_flags)))
-        goto done;
-    PyTuple_SET_ITEM(args, 0, obj);
+        goto fail;
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong(attrp->mq_maxmsg)))
-        goto done;
-    PyTuple_SET_ITEM(args, 1, obj);
+        goto fail;
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong(attrp->mq_msgsize)))
-        goto done;
-    PyTuple_SET_ITEM(args, 2, obj);
+        goto fail;
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong(attrp->mq_curmsgs)))
-        goto done;
-    PyTuple_SET_ITEM(args, 3, obj);
+        goto fail;
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
-    result = PyObject_Call(py_mq_attr, args, NULL);
-
-done:
-    Py_DECREF(args);
     return result;
+
+fail:
+    Py_DECREF(result);
+    return NULL;
 }
 
 int
@@ -153,6 +207,8 @@ python_mq_open(PyObject *module, PyObject *args, PyObject *kwargs) {
     return PyInt_FromLong((long)result);
 }
 
+static int notify_mq_close(int mqdes);
+
 static PyObject *
 python_mq_close(PyObject *module, PyObject *args) {
     int mqdes;
@@ -160,7 +216,7 @@ python_mq_close(PyObject *module, PyObject *args) {
     if (!PyArg_ParseTuple(args, "i", &mqdes))
         return NULL;
 
-    if (mq_close(mqdes) < 0) {
+    if (notify_mq_close(mqdes) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
@@ -226,48 +282,309 @@ python_mq_receive(PyObject *module, PyObject *args, PyObject *kwargs) {
     int mqdes;
     double dtimeout = -1;
     struct timespec timeout;
-    size_t size = MSGSIZE_MAX;
+    Py_ssize_t size = -1;
     ssize_t received;
     unsigned int prio;
-    PyObject *obj, *result;
+    struct mq_attr attr;
+    PyObject *msg;
 
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|dn", mqreceive_kwargs,
                 &mqdes, &dtimeout, &size))
         return NULL;
 
-    char buf[size];
-    char *msg = &buf[0];
-
-    if (dtimeout < 0) {
-        received = mq_receive((mqd_t)mqdes, msg, size, &prio);
-    } else {
-        if (abs_timespec_ify(dtimeout, &timeout) < 0) {
-            PyErr_SetString(PyExc_ValueError, "bad timeout float");
+    /* the queue's own message size is exactly what mq_receive requires */
+    if (size < 0) {
+        if (mq_getattr((mqd_t)mqdes, &attr) < 0) {
+            PyErr_SetFromErrno(PyExc_OSError);
             return NULL;
         }
-        received = mq_timedreceive((mqd_t)mqdes, msg, size, &prio, &timeout);
+        size = attr.mq_msgsize;
     }
 
+    if (dtimeout >= 0 && abs_timespec_ify(dtimeout, &timeout) < 0) {
+        PyErr_SetString(PyExc_ValueError, "bad timeout float");
+        return NULL;
+    }
+
+    /* receive straight into the string, then trim it to the message */
+    if (NULL == (msg = PyString_FromStringAndSize(NULL, size)))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (dtimeout < 0)
+        received = mq_receive((mqd_t)mqdes, PyString_AS_STRING(msg),
+                (size_t)size, &prio);
+    else
+        received = mq_timedreceive((mqd_t)mqdes, PyString_AS_STRING(msg),
+                (size_t)size, &prio, &timeout);
+    Py_END_ALLOW_THREADS
+
     if (received < 0) {
+        Py_DECREF(msg);
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
-    if (NULL == (obj = PyInt_FromLong((long)prio)))
+    if (received != size && _PyString_Resize(&msg, received) < 0)
+        return NULL;
+
+    return Py_BuildValue("(IN)", prio, msg);
+}
+
+static char *mqreceive_into_kwargs[] = {"mqdes", "buffer", "timeout", NULL};
+
+static PyObject *
+python_mq_receive_into(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int mqdes;
+    double dtimeout = -1;
+    struct timespec timeout;
+    Py_buffer buffer;
+    ssize_t received;
+    unsigned int prio;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iw*|d",
+                mqreceive_into_kwargs, &mqdes, &buffer, &dtimeout))
         return NULL;
 
-    if (NULL == (result = PyTuple_New(2))) {
-        Py_DECREF(obj);
+    if (dtimeout >= 0 && abs_timespec_ify(dtimeout, &timeout) < 0) {
+        PyBuffer_Release(&buffer);
+        PyErr_SetString(PyExc_ValueError, "bad timeout float");
         return NULL;
     }
-    PyTuple_SET_ITEM(result, 0, obj);
 
-    if (NULL == (obj = PyString_FromStringAndSize(msg, received))) {
-        Py_DECREF(result);
+    Py_BEGIN_ALLOW_THREADS
+    if (dtimeout < 0)
+        received = mq_receive((mqd_t)mqdes, buffer.buf, (size_t)buffer.len,
+                &prio);
+    else
+        received = mq_timedreceive((mqd_t)mqdes, buffer.buf,
+                (size_t)buffer.len, &prio, &timeout);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&buffer);
+
+    if (received < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return Py_BuildValue("(In)", prio, (Py_ssize_t)received);
+}
+
+static char *mqsend_many_kwargs[] = {"mqdes", "msgs", "timeout", NULL};
+
+static PyObject *
+python_mq_send_many(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int mqdes, result = 0;
+    double dtimeout = -1;
+    struct timespec timeout;
+    PyObject *msgs, *seq, *item;
+    Py_ssize_t count, i, sent = 0;
+    Py_buffer *buffers;
+    unsigned int *prios;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO|d", mqsend_many_kwargs,
+                &mqdes, &msgs, &dtimeout))
+        return NULL;
+
+    if (dtimeout >= 0 && abs_timespec_ify(dtimeout, &timeout) < 0) {
+        PyErr_SetString(PyExc_ValueError, "bad timeout float");
+        return NULL;
+    }
+
+    if (NULL == (seq = PySequence_Fast(msgs, "msgs must be a sequence")))
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    buffers = malloc(sizeof(Py_buffer) * (count ? count : 1));
+    prios = malloc(sizeof(unsigned int) * (count ? count : 1));
+    if (NULL == buffers || NULL == prios) {
+        free(buffers);
+        free(prios);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    /* pin every message first, so the sends can all go without the GIL */
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyTuple_Check(item) || !PyArg_ParseTuple(item, "s*I;msgs must "
+                    "hold (msg, prio) pairs", &buffers[i], &prios[i])) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_TypeError,
+                        "msgs must hold (msg, prio) pairs");
+            count = i;
+            goto done;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (; sent < count; ++sent) {
+        if (dtimeout < 0)
+            result = mq_send((mqd_t)mqdes, buffers[sent].buf,
+                    (size_t)buffers[sent].len, prios[sent]);
+        else
+            result = mq_timedsend((mqd_t)mqdes, buffers[sent].buf,
+                    (size_t)buffers[sent].len, prios[sent], &timeout);
+        if (result < 0) break;
+    }
+    Py_END_ALLOW_THREADS
+
+    /* a full queue part way through isn't an error, the count says so */
+    if (result < 0 && (!sent || (EAGAIN != errno && ETIMEDOUT != errno)))
+        PyErr_SetFromErrno(PyExc_OSError);
+
+done:
+    for (i = 0; i < count; ++i)
+        PyBuffer_Release(&buffers[i]);
+    free(buffers);
+    free(prios);
+    Py_DECREF(seq);
+
+    if (PyErr_Occurred())
+        return NULL;
+    return PyInt_FromLong((long)sent);
+}
+
+/*
+ * a batch of messages received into a single arena. it's set up and turned
+ * into python objects with the GIL held, and filled in without it.
+ */
+typedef struct {
+    char *arena;
+    ssize_t *lengths;
+    unsigned int *prios;
+    size_t msgsize;
+    int max;
+    int count;
+} mq_batch;
+
+static int
+mq_batch_init(mq_batch *batch, mqd_t mqdes, int max) {
+    struct mq_attr attr;
+
+    if (mq_getattr(mqdes, &attr) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+
+    /* the queue never holds more than mq_maxmsg, so that bounds the arena */
+    if (max > attr.mq_maxmsg)
+        max = (int)attr.mq_maxmsg;
+
+    batch->msgsize = (size_t)attr.mq_msgsize;
+    batch->max = max;
+    batch->count = 0;
+    /* one allocation, the lengths first since the message area's size
+     * needn't leave them aligned. free it through batch->lengths */
+    batch->lengths = malloc(
+            (sizeof(ssize_t) + sizeof(unsigned int) + batch->msgsize) * max);
+    if (NULL == batch->lengths) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    batch->prios = (unsigned int *)(batch->lengths + max);
+    batch->arena = (char *)(batch->prios + max);
+
+    return 0;
+}
+
+/*
+ * receive up to max messages. with wait, the first may block (until timeout
+ * if it isn't NULL), the rest are drained with an already expired timeout,
+ * which doesn't wait even on a blocking descriptor. errno is left from the
+ * failed receive that ended the batch.
+ */
+static void
+mq_batch_fill(mq_batch *batch, mqd_t mqdes, int wait,
+        struct timespec *timeout) {
+    struct timespec expired = {0, 0};
+    ssize_t *lengths = batch->lengths;
+    unsigned int *prios = batch->prios;
+    size_t msgsize = batch->msgsize;
+    int i = 0;
+
+    if (wait) {
+        if (NULL == timeout)
+            lengths[0] = mq_receive(mqdes, batch->arena, msgsize, &prios[0]);
+        else
+            lengths[0] = mq_timedreceive(mqdes, batch->arena, msgsize,
+                    &prios[0], timeout);
+        if (lengths[0] < 0) {
+            batch->count = 0;
+            return;
+        }
+        i = 1;
+    }
+
+    for (; i < batch->max; ++i) {
+        lengths[i] = mq_timedreceive(mqdes, batch->arena + msgsize * i,
+                msgsize, &prios[i], &expired);
+        if (lengths[i] < 0) break;
+    }
+    batch->count = i;
+}
+
+static PyObject *
+mq_batch_list(mq_batch *batch) {
+    PyObject *result, *item;
+    int i;
+
+    if (NULL == (result = PyList_New(batch->count)))
+        return NULL;
+
+    for (i = 0; i < batch->count; ++i) {
+        item = Py_BuildValue("(IN)", batch->prios[i],
+                PyString_FromStringAndSize(batch->arena + batch->msgsize * i,
+                    batch->lengths[i]));
+        if (NULL == item) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return result;
+}
+
+static char *mqreceive_many_kwargs[] = {"mqdes", "max", "timeout", NULL};
+
+static PyObject *
+python_mq_receive_many(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int mqdes, max = 64;
+    double dtimeout = -1;
+    struct timespec timeout;
+    mq_batch batch;
+    PyObject *result;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|id",
+                mqreceive_many_kwargs, &mqdes, &max, &dtimeout))
+        return NULL;
+
+    if (max <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max must be positive");
         return NULL;
     }
-    PyTuple_SET_ITEM(result, 1, obj);
 
+    if (dtimeout >= 0 && abs_timespec_ify(dtimeout, &timeout) < 0) {
+        PyErr_SetString(PyExc_ValueError, "bad timeout float");
+        return NULL;
+    }
+
+    if (mq_batch_init(&batch, (mqd_t)mqdes, max) < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    mq_batch_fill(&batch, (mqd_t)mqdes, 1, dtimeout < 0 ? NULL : &timeout);
+    Py_END_ALLOW_THREADS
+
+    if (!batch.count) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        result = NULL;
+    } else
+        result = mq_batch_list(&batch);
+
+    free(batch.lengths);
     return result;
 }
 
@@ -307,6 +624,79 @@ python_mq_setattr(PyObject *module, PyObject *args) {
     return dump_mqattr(&oldattr);
 }
 
+/*
+ * eventfd notification
+ *
+ * SIGEV_THREAD notifications run on a helper thread that never touches
+ * python, so the eventfd each queue reports to lives in a mutex-guarded table
+ * indexed by queue descriptor rather than behind the sigevent's pointer,
+ * where an unregister could free it out from under a running notification.
+ * the table holds its own dup of each eventfd, so the caller closing theirs
+ * can't leave the helper writing to whatever reuses the number.
+ */
+
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
+static int *notify_table = NULL;
+static int notify_size = 0;
+
+static void mq_notify_thread(union sigval value);
+
+static void
+notify_sigevent(struct sigevent *sigev, int mqdes) {
+    memset(sigev, 0, sizeof(struct sigevent));
+    sigev->sigev_notify = SIGEV_THREAD;
+    sigev->sigev_notify_function = mq_notify_thread;
+    sigev->sigev_value.sival_int = mqdes;
+}
+
+/* must be called with notify_lock held */
+static void
+notify_clear(int mqdes) {
+    if (mqdes >= 0 && mqdes < notify_size && notify_table[mqdes] >= 0) {
+        close(notify_table[mqdes]);
+        notify_table[mqdes] = -1;
+    }
+}
+
+/* mq_close(3), dropping any eventfd registration with the lock held so a
+ * notification in flight can't re-arm the queue that gets the number next */
+static int
+notify_mq_close(int mqdes) {
+    int rc;
+
+    pthread_mutex_lock(&notify_lock);
+    notify_clear(mqdes);
+    rc = mq_close((mqd_t)mqdes);
+    pthread_mutex_unlock(&notify_lock);
+    return rc;
+}
+
+static void
+mq_notify_thread(union sigval value) {
+    struct sigevent sigev;
+    uint64_t one = 1;
+    int mqdes = value.sival_int;
+    int efd, rc;
+
+    pthread_mutex_lock(&notify_lock);
+
+    if (mqdes < notify_size && (efd = notify_table[mqdes]) >= 0) {
+        /* a notification is a one-shot, so re-arm before the eventfd can
+         * wake anybody up to drain the queue. a message that lands after the
+         * drain then finds us registered again. */
+        notify_sigevent(&sigev, mqdes);
+        rc = mq_notify((mqd_t)mqdes, &sigev);
+
+        /* EAGAIN is a saturated counter, which is readable anyway */
+        if (write(efd, &one, 8) < 0) {}
+
+        if (rc < 0)
+            notify_clear(mqdes);
+    }
+
+    pthread_mutex_unlock(&notify_lock);
+}
+
 static char *mqnotify_kwargs[] = {"mqdes", "signo", NULL};
 
 static PyObject *
@@ -326,232 +716,3373 @@ python_mq_notify(PyObject *module, PyObject *args, PyObject *kwargs) {
         sigevp = NULL;
     }
 
+    /* whatever this does, it replaces an eventfd registration, and the lock
+     * keeps a running notification from re-arming one that's being removed */
+    pthread_mutex_lock(&notify_lock);
     if (mq_notify(mqdes, sigevp) < 0) {
+        pthread_mutex_unlock(&notify_lock);
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
+    notify_clear(mqdes);
+    pthread_mutex_unlock(&notify_lock);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-static char *semopen_kwargs[] = {"name", "flags", "mode", "value", NULL};
+static char *mqnotify_eventfd_kwargs[] = {"mqdes", "eventfd", NULL};
 
 static PyObject *
-python_sem_open(PyObject *module, PyObject *args, PyObject *kwargs) {
-    char *name;
-    int flags = 0;
-    unsigned int mode = 0, value = 0;
-    sem_t *semp;
+python_mq_notify_eventfd(PyObject *module, PyObject *args, PyObject *kwargs) {
+    int mqdes, efd, size, i, *table;
+    PyObject *pyefd;
+    struct sigevent sigev;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iii", semopen_kwargs,
-                &name, &flags, &mode, &value))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO",
+                mqnotify_eventfd_kwargs, &mqdes, &pyefd))
         return NULL;
 
-    if (SEM_FAILED == (semp = sem_open(name, flags, (mode_t)mode, value))) {
+    if ((efd = PyObject_AsFileDescriptor(pyefd)) < 0)
+        return NULL;
+
+    if (mqdes < 0) {
+        errno = EBADF;
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
-    return PyLong_FromVoidPtr(semp);
-}
+    if ((efd = fcntl(efd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
 
-static PyObject *
-python_sem_close(PyObject *module, PyObject *args) {
-    PyObject *pysem;
-    sem_t *semp;
+    pthread_mutex_lock(&notify_lock);
 
-    if (!PyArg_ParseTuple(args, "O", &pysem))
-        return NULL;
+    if (mqdes >= notify_size) {
+        size = notify_size ? notify_size : 64;
+        while (size <= mqdes) size *= 2;
+        if (NULL == (table = realloc(notify_table, sizeof(int) * size))) {
+            pthread_mutex_unlock(&notify_lock);
+            close(efd);
+            return PyErr_NoMemory();
+        }
+        for (i = notify_size; i < size; ++i)
+            table[i] = -1;
+        notify_table = table;
+        notify_size = size;
+    }
 
-    if (find_sem_ptr(pysem, (void **)&semp) < 0)
-        return NULL;
+    /* an entry means the queue is still armed (the helper drops it when
+     * re-arming fails), so only the eventfd changes */
+    if (notify_table[mqdes] >= 0) {
+        close(notify_table[mqdes]);
+        notify_table[mqdes] = efd;
+        pthread_mutex_unlock(&notify_lock);
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
 
-    if (sem_close(semp) < 0) {
+    notify_table[mqdes] = efd;
+    notify_sigevent(&sigev, mqdes);
+    if (mq_notify((mqd_t)mqdes, &sigev) < 0) {
+        notify_clear(mqdes);
+        pthread_mutex_unlock(&notify_lock);
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
+    pthread_mutex_unlock(&notify_lock);
+
     Py_INCREF(Py_None);
     return Py_None;
 }
 
+/*
+ * MQSelector objects
+ *
+ * linux message queue descriptors are real file descriptors, so many queues
+ * can share one epoll instance. the wait happens without the GIL, and when
+ * asked to, so do the nonblocking receives that drain the ready queues.
+ *
+ * epoll forgets a descriptor by itself once it's closed, so which ones are
+ * registered is tracked here too, in a table indexed by descriptor.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    int epfd;
+    int count;
+    int size;
+    struct epoll_event *events;
+    char *registered;
+    int nregistered;
+} python_mqselector_object;
+
+/* epoll_wait's timeout in ms, rounded up so a short wait doesn't spin */
+static int
+epoll_timeout_ms(double secs) {
+    double ms = secs * 1000;
+
+    if (ms >= INT_MAX)
+        return INT_MAX;
+    return (int)ms + ((int)ms < ms);
+}
+
 static PyObject *
-python_sem_unlink(PyObject *module, PyObject *args) {
-    char *name;
+python_mqselector_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_mqselector_object *self;
 
-    if (!PyArg_ParseTuple(args, "s", &name))
+    if (!PyArg_ParseTuple(args, ""))
         return NULL;
 
-    if (sem_unlink(name) < 0) {
+    if (!(self = (python_mqselector_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->epfd = -1;
+    self->count = 0;
+    self->size = 0;
+    self->events = NULL;
+    self->registered = NULL;
+    self->nregistered = 0;
+
+    if ((self->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
+        Py_DECREF(self);
         return NULL;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    return (PyObject *)self;
+}
+
+static void
+python_mqselector_dealloc(python_mqselector_object *self) {
+    if (self->epfd >= 0)
+        close(self->epfd);
+    free(self->events);
+    free(self->registered);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+mqselector_check(python_mqselector_object *self) {
+    if (self->epfd < 0) {
+        PyErr_SetString(PyExc_ValueError, "MQSelector is closed");
+        return -1;
+    }
+    return 0;
 }
 
 static PyObject *
-python_sem_init(PyObject *module, PyObject *args) {
-    PyObject *pysem;
-    void *mem;
-    int pshared;
-    unsigned int value;
+python_mqselector_register(python_mqselector_object *self, PyObject *args) {
+    int mqdes, size;
+    struct epoll_event event;
+    struct epoll_event *events;
+    char *registered;
 
-    if (!PyArg_ParseTuple(args, "Oii", &pysem, &pshared, &value))
+    if (!PyArg_ParseTuple(args, "i", &mqdes))
         return NULL;
 
-    if (find_sem_ptr(pysem, &mem) < 0)
+    if (mqselector_check(self))
         return NULL;
 
-    if (sem_init((sem_t *)mem, pshared, value) < 0) {
+    if (mqdes < 0) {
+        errno = EBADF;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (mqdes >= self->nregistered) {
+        size = self->nregistered ? self->nregistered : 64;
+        while (size <= mqdes) size *= 2;
+        if (NULL == (registered = realloc(self->registered, size)))
+            return PyErr_NoMemory();
+        memset(registered + self->nregistered, 0, size - self->nregistered);
+        self->registered = registered;
+        self->nregistered = size;
+    }
+
+    /* make sure one select() can report every registered queue */
+    if (self->count == self->size) {
+        size = self->size ? self->size * 2 : 8;
+        events = realloc(self->events, sizeof(struct epoll_event) * size);
+        if (NULL == events) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        self->events = events;
+        self->size = size;
+    }
+
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    event.data.fd = mqdes;
+    if (epoll_ctl(self->epfd, EPOLL_CTL_ADD, mqdes, &event) < 0) {
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
 
+    /* already counted if it was closed and the number reused */
+    if (!self->registered[mqdes]) {
+        self->registered[mqdes] = 1;
+        self->count++;
+    }
+
     Py_INCREF(Py_None);
     return Py_None;
 }
 
 static PyObject *
-python_sem_destroy(PyObject *module, PyObject *args) {
-    PyObject *pysem;
-    void *mem;
+python_mqselector_unregister(python_mqselector_object *self, PyObject *args) {
+    int mqdes;
+    struct epoll_event event;
 
-    if (!PyArg_ParseTuple(args, "O", &pysem))
+    if (!PyArg_ParseTuple(args, "i", &mqdes))
+        return NULL;
+
+    if (mqselector_check(self))
+        return NULL;
+
+    /* a queue closed since registering has already gone from the epoll set,
+     * but not from our count */
+    if (mqdes < 0 || mqdes >= self->nregistered ||
+            !self->registered[mqdes]) {
+        if (epoll_ctl(self->epfd, EPOLL_CTL_DEL, mqdes, &event) < 0) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+    } else {
+        if (epoll_ctl(self->epfd, EPOLL_CTL_DEL, mqdes, &event) < 0 &&
+                EBADF != errno && ENOENT != errno) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        self->registered[mqdes] = 0;
+        self->count--;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+mqselector_receive(python_mqselector_object *self, int count, int receive) {
+    mq_batch *batches;
+    PyObject *result = NULL, *item;
+    int i, ready = 0;
+    mqd_t mqdes;
+
+    if (NULL == (batches = malloc(sizeof(mq_batch) * count)))
+        return PyErr_NoMemory();
+
+    for (ready = 0; ready < count; ++ready) {
+        mqdes = (mqd_t)self->events[ready].data.fd;
+        if (mq_batch_init(&batches[ready], mqdes, receive) < 0) {
+            if (PyErr_ExceptionMatches(PyExc_MemoryError))
+                goto done;
+            /* one bad queue (closed meanwhile, say) shouldn't cost the
+             * others their messages, it's just left out */
+            PyErr_Clear();
+            batches[ready].lengths = NULL;
+            batches[ready].count = 0;
+        }
+    }
+
+    /* another reader may have emptied a queue since the wakeup, in which
+     * case its batch just comes back with nothing in it */
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 0; i < count; ++i) {
+        if (NULL != batches[i].lengths)
+            mq_batch_fill(&batches[i], (mqd_t)self->events[i].data.fd, 0,
+                    NULL);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (NULL == (result = PyList_New(0)))
+        goto done;
+
+    for (i = 0; i < count; ++i) {
+        if (!batches[i].count)
+            continue;
+        item = Py_BuildValue("(iN)", self->events[i].data.fd,
+                mq_batch_list(&batches[i]));
+        if (NULL == item || PyList_Append(result, item) < 0) {
+            Py_XDECREF(item);
+            Py_CLEAR(result);
+            goto done;
+        }
+        Py_DECREF(item);
+    }
+
+done:
+    for (i = 0; i < ready; ++i)
+        free(batches[i].lengths);
+    free(batches);
+    return result;
+}
+
+static char *mqselector_select_kwargs[] = {"timeout", "receive", NULL};
+
+static PyObject *
+python_mqselector_select(python_mqselector_object *self, PyObject *args,
+        PyObject *kwargs) {
+    double timeout = -1, deadline = 0, left;
+    int receive = 0, count, i, ms;
+    PyObject *result, *item;
+    struct timespec now;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|di",
+                mqselector_select_kwargs, &timeout, &receive))
+        return NULL;
+
+    if (mqselector_check(self))
+        return NULL;
+
+    if (!self->size)
+        return PyList_New(0);
+
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = now.tv_sec + now.tv_nsec / 1e9 + timeout;
+    }
+    ms = timeout < 0 ? -1 : epoll_timeout_ms(timeout);
+
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+        count = epoll_wait(self->epfd, self->events, self->size, ms);
+        Py_END_ALLOW_THREADS
+
+        if (count >= 0)
+            break;
+
+        /* PEP 475, as in penguin.loop */
+        if (EINTR != errno) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        if (PyErr_CheckSignals() || mqselector_check(self))
+            return NULL;
+        if (timeout >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left = deadline - now.tv_sec - now.tv_nsec / 1e9;
+            ms = left > 0 ? epoll_timeout_ms(left) : 0;
+        }
+    }
+
+    if (receive > 0 && count)
+        return mqselector_receive(self, count, receive);
+
+    if (NULL == (result = PyList_New(count)))
+        return NULL;
+
+    for (i = 0; i < count; ++i) {
+        if (NULL == (item = PyInt_FromLong((long)self->events[i].data.fd))) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return result;
+}
+
+static PyObject *
+python_mqselector_fileno(python_mqselector_object *self, PyObject *iamnull) {
+    return PyInt_FromLong((long)self->epfd);
+}
+
+static PyObject *
+python_mqselector_close(python_mqselector_object *self, PyObject *iamnull) {
+    if (self->epfd >= 0 && close(self->epfd) < 0) {
+        self->epfd = -1;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->epfd = -1;
+    self->count = 0;
+    if (NULL != self->registered)
+        memset(self->registered, 0, self->nregistered);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static Py_ssize_t
+python_mqselector_length(python_mqselector_object *self) {
+    return (Py_ssize_t)self->count;
+}
+
+static PySequenceMethods mqselector_as_sequence = {
+    (lenfunc)python_mqselector_length,         /* sq_length */
+};
+
+static PyMethodDef mqselector_methods[] = {
+    {"register", (PyCFunction)python_mqselector_register, METH_VARARGS,
+        "start watching a message queue\n\
+\n\
+:param int mqdes: the message queue descriptor\n\
+"},
+    {"unregister", (PyCFunction)python_mqselector_unregister, METH_VARARGS,
+        "stop watching a message queue\n\
+\n\
+a queue that has been closed since it was registered is no longer watched\n\
+anyway, but still has to be unregistered to leave ``len()``.\n\
+\n\
+:param int mqdes: the message queue descriptor\n\
+"},
+    {"select", (PyCFunction)python_mqselector_select,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait for registered message queues to have messages\n\
+\n\
+:param float timeout:\n\
+    the longest to wait, in seconds. negative (the default) waits\n\
+    indefinitely, 0 doesn't wait at all.\n\
+\n\
+:param int receive:\n\
+    if positive, also receive up to this many messages from each ready\n\
+    queue. this never blocks, and queues that turn out to be empty, or that\n\
+    can't be read, are left out of the result.\n\
+\n\
+:returns:\n\
+    a list of the ready message queue descriptors, or with ``receive``, a\n\
+    list of ``(mqdes, messages)`` pairs where ``messages`` is a list of\n\
+    ``(priority, message)`` as from :func:`mq_receive_many`.\n\
+"},
+    {"fileno", (PyCFunction)python_mqselector_fileno, METH_NOARGS,
+        "get the epoll file descriptor\n\
+\n\
+:returns:\n\
+    integer file descriptor, which is readable when a registered queue is\n\
+"},
+    {"close", (PyCFunction)python_mqselector_close, METH_NOARGS,
+        "close the epoll file descriptor, the queues themselves are untouched\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_mqselector_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_ipc.MQSelector",            /* tp_name */
+    sizeof(python_mqselector_object),          /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_mqselector_dealloc,     /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &mqselector_as_sequence,                   /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "MQSelector()\n\
+\n\
+waits on many message queues at once\n\
+\n\
+its epoll fd is closed when the object is garbage collected.",  /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    mqselector_methods,                        /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_mqselector_new,                     /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+
+static char *semopen_kwargs[] = {"name", "flags", "mode", "value", NULL};
+
+static PyObject *
+python_sem_open(PyObject *module, PyObject *args, PyObject *kwargs) {
+    char *name;
+    int flags = 0;
+    unsigned int mode = 0, value = 0;
+    sem_t *semp;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iii", semopen_kwargs,
+                &name, &flags, &mode, &value))
+        return NULL;
+
+    if (SEM_FAILED == (semp = sem_open(name, flags, (mode_t)mode, value))) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyLong_FromVoidPtr(semp);
+}
+
+static PyObject *
+python_sem_close(PyObject *module, PyObject *args) {
+    PyObject *pysem;
+    sem_t *semp;
+
+    if (!PyArg_ParseTuple(args, "O", &pysem))
+        return NULL;
+
+    if (find_sem_ptr(pysem, (void **)&semp) < 0)
+        return NULL;
+
+    if (sem_close(semp) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_sem_unlink(PyObject *module, PyObject *args) {
+    char *name;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+
+    if (sem_unlink(name) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_sem_init(PyObject *module, PyObject *args) {
+    PyObject *pysem;
+    void *mem;
+    int pshared;
+    unsigned int value;
+
+    if (!PyArg_ParseTuple(args, "Oii", &pysem, &pshared, &value))
+        return NULL;
+
+    if (find_sem_ptr(pysem, &mem) < 0)
+        return NULL;
+
+    if (sem_init((sem_t *)mem, pshared, value) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_sem_destroy(PyObject *module, PyObject *args) {
+    PyObject *pysem;
+    void *mem;
+
+    if (!PyArg_ParseTuple(args, "O", &pysem))
+        return NULL;
+
+    if (find_sem_ptr(pysem, &mem) < 0)
+        return NULL;
+
+    if (sem_destroy(mem) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_sem_getvalue(PyObject *module, PyObject *args) {
+    PyObject *pysem;
+    sem_t *semp;
+    int val;
+
+    if (!PyArg_ParseTuple(args, "O", &pysem))
+        return NULL;
+
+    if (find_sem_ptr(pysem, (void **)&semp) < 0)
+        return NULL;
+
+    if (sem_getvalue(semp, &val) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)val);
+}
+
+static PyObject *
+python_sem_post(PyObject *module, PyObject *args) {
+    PyObject *pysem;
+    sem_t *semp;
+
+    if (!PyArg_ParseTuple(args, "O", &pysem))
+        return NULL;
+
+    if (find_sem_ptr(pysem, (void **)&semp) < 0)
+        return NULL;
+
+    if (sem_post(semp) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *semwait_kwargs[] = {"sem", "try", "timeout", NULL};
+
+static PyObject *
+python_sem_wait(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *pysem, *pytry = Py_False;
+    sem_t *semp;
+    double dtimeout = -1;
+    struct timespec timeout;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Od", semwait_kwargs,
+                &pysem, &pytry, &dtimeout))
+        return NULL;
+
+    if (find_sem_ptr(pysem, (void **)&semp))
+        return NULL;
+
+    if (PyObject_IsTrue(pytry)) {
+        if (dtimeout > 0) {
+            PyErr_SetString(PyExc_ValueError,
+                    "both 'try' and 'timeout' can not be provided");
+            return NULL;
+        }
+        rc = sem_trywait(semp);
+    } else if (dtimeout > 0) {
+        if (abs_timespec_ify(dtimeout, &timeout) < 0) {
+            PyErr_SetString(PyExc_ValueError, "bad timeout float");
+            return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        rc = sem_timedwait(semp, &timeout);
+        Py_END_ALLOW_THREADS
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        rc = sem_wait(semp);
+        Py_END_ALLOW_THREADS
+    }
+
+    if (rc < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/*
+ * Semaphore objects
+ *
+ * the sem_t pointer is resolved once, at construction. sem_trywait is
+ * attempted with the GIL held, so it's only released for a wait that's
+ * actually going to block.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    sem_t *sem;
+    Py_buffer owner; /* owner.obj is NULL when there's no buffer to pin */
+    int named;
+} python_semaphore_object;
+
+static char *semaphore_kwargs[] = {"sem", "flags", "mode", "value", NULL};
+
+static PyObject *
+python_semaphore_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_semaphore_object *self;
+    PyObject *pysem;
+    int flags = 0;
+    unsigned int mode = 0600, value = 0;
+    sem_t *semp;
+    char *name;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iII", semaphore_kwargs,
+                &pysem, &flags, &mode, &value))
+        return NULL;
+
+    if (!(self = (python_semaphore_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->sem = NULL;
+    self->owner.obj = NULL;
+    self->named = 0;
+
+    if (PyUnicode_Check(pysem)
+#if PY_MAJOR_VERSION < 3
+            || PyString_Check(pysem)
+#endif
+            ) {
+        if (!PyArg_Parse(pysem, "s", &name)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+        if (SEM_FAILED == (semp = sem_open(name, flags, (mode_t)mode,
+                        value))) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            Py_DECREF(self);
+            return NULL;
+        }
+        self->named = 1;
+    } else {
+        if (find_sem_ptr(pysem, (void **)&semp) < 0) {
+            Py_DECREF(self);
+            return NULL;
+        }
+        /* keep the memory the semaphore lives in mapped. an exported
+         * buffer stops mmap.close(), where a plain reference wouldn't */
+        if (!PyInt_Check(pysem) && !PyLong_Check(pysem) &&
+                PyObject_GetBuffer(pysem, &self->owner, PyBUF_WRITABLE) < 0) {
+            self->owner.obj = NULL;
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    self->sem = semp;
+
+    return (PyObject *)self;
+}
+
+static void
+semaphore_close(python_semaphore_object *self) {
+    if (NULL != self->sem && self->named)
+        sem_close(self->sem);
+    self->sem = NULL;
+    if (NULL != self->owner.obj)
+        PyBuffer_Release(&self->owner);
+}
+
+static void
+python_semaphore_dealloc(python_semaphore_object *self) {
+    semaphore_close(self);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+semaphore_check(python_semaphore_object *self) {
+    if (NULL == self->sem) {
+        PyErr_SetString(PyExc_ValueError, "Semaphore is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 if acquired, 0 if not, -1 with an exception set */
+static int
+semaphore_acquire(python_semaphore_object *self, int blocking,
+        double timeout) {
+    struct timespec deadline;
+    int rc;
+
+    if (!sem_trywait(self->sem))
+        return 1;
+    if (EAGAIN != errno) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    if (!blocking || 0 == timeout)
+        return 0;
+
+    if (timeout > 0) {
+#ifdef SEM_CLOCKWAIT_MISSING
+        /* sem_timedwait only knows CLOCK_REALTIME */
+        abs_timespec_ify(timeout, &deadline);
+#else
+        clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+#endif
+    }
+
+    while (1) {
+        Py_BEGIN_ALLOW_THREADS
+        if (timeout < 0)
+            rc = sem_wait(self->sem);
+        else
+#ifdef SEM_CLOCKWAIT_MISSING
+            rc = sem_timedwait(self->sem, &deadline);
+#else
+            rc = sem_clockwait(self->sem, CLOCK_MONOTONIC, &deadline);
+#endif
+        Py_END_ALLOW_THREADS
+
+        if (!rc)
+            return 1;
+        if (ETIMEDOUT == errno)
+            return 0;
+        if (EINTR != errno) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+        /* a signal handler may raise, otherwise resume the same deadline */
+        if (PyErr_CheckSignals())
+            return -1;
+    }
+}
+
+static char *semaphore_acquire_kwargs[] = {"blocking", "timeout", NULL};
+
+static PyObject *
+python_semaphore_acquire(python_semaphore_object *self, PyObject *args,
+        PyObject *kwargs) {
+    PyObject *pyblocking = Py_True;
+    double timeout = -1;
+    int rc, blocking;
+
+    if ((PyTuple_GET_SIZE(args) || kwargs) && !PyArg_ParseTupleAndKeywords(
+                args, kwargs, "|Od", semaphore_acquire_kwargs, &pyblocking,
+                &timeout))
+        return NULL;
+
+    if (semaphore_check(self))
+        return NULL;
+
+    if ((blocking = PyObject_IsTrue(pyblocking)) < 0)
+        return NULL;
+
+    if ((rc = semaphore_acquire(self, blocking, timeout)) < 0)
+        return NULL;
+
+    return PyBool_FromLong(rc);
+}
+
+static PyObject *
+python_semaphore_release(python_semaphore_object *self, PyObject *iamnull) {
+    if (semaphore_check(self))
+        return NULL;
+
+    if (sem_post(self->sem) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_semaphore_getvalue(python_semaphore_object *self, PyObject *iamnull) {
+    int value;
+
+    if (semaphore_check(self))
+        return NULL;
+
+    if (sem_getvalue(self->sem, &value) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)value);
+}
+
+static PyObject *
+python_semaphore_enter(python_semaphore_object *self, PyObject *iamnull) {
+    if (semaphore_check(self))
+        return NULL;
+
+    if (semaphore_acquire(self, 1, -1) < 0)
+        return NULL;
+
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+python_semaphore_exit(python_semaphore_object *self, PyObject *args) {
+    return python_semaphore_release(self, NULL);
+}
+
+static PyObject *
+python_semaphore_close(python_semaphore_object *self, PyObject *iamnull) {
+    if (NULL != self->sem && self->named && sem_close(self->sem) < 0) {
+        self->sem = NULL;
+        if (NULL != self->owner.obj)
+            PyBuffer_Release(&self->owner);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->named = 0;
+    semaphore_close(self);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyMethodDef semaphore_methods[] = {
+    {"acquire", (PyCFunction)python_semaphore_acquire,
+        METH_VARARGS | METH_KEYWORDS,
+        "decrement the semaphore, waiting if it's at 0\n\
+\n\
+:param bool blocking:\n\
+    if ``False``, give up instead of waiting. defaults to ``True``.\n\
+\n\
+:param float timeout:\n\
+    the longest to wait, in seconds, measured on ``CLOCK_MONOTONIC`` so it\n\
+    isn't thrown off by changes to the system time. negative (the default)\n\
+    waits indefinitely.\n\
+\n\
+:returns: ``True`` if the semaphore was decremented, otherwise ``False``\n\
+"},
+    {"release", (PyCFunction)python_semaphore_release, METH_NOARGS,
+        "increment the semaphore, waking up a waiter\n\
+"},
+    {"getvalue", (PyCFunction)python_semaphore_getvalue, METH_NOARGS,
+        "get the semaphore's current value\n\
+\n\
+:returns: integer value\n\
+"},
+    {"close", (PyCFunction)python_semaphore_close, METH_NOARGS,
+        "stop using the semaphore\n\
+\n\
+a named semaphore is closed with sem_close(3), but not unlinked (see\n\
+:func:`sem_unlink`). an unnamed one is left as it is.\n\
+"},
+    {"__enter__", (PyCFunction)python_semaphore_enter, METH_NOARGS,
+        "acquire the semaphore, waiting as long as it takes\n\
+"},
+    {"__exit__", (PyCFunction)python_semaphore_exit, METH_VARARGS,
+        "release the semaphore\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_semaphore_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_ipc.Semaphore",             /* tp_name */
+    sizeof(python_semaphore_object),           /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_semaphore_dealloc,      /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    0,                                         /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "Semaphore(sem, flags=0, mode=0600, value=0)\n\
+\n\
+a POSIX semaphore\n\
+\n\
+``sem`` is either the '/' prefixed name of a named semaphore, which is\n\
+opened as with :func:`sem_open` using ``flags``, ``mode`` and ``value``, or\n\
+the location of an unnamed one as accepted by :func:`sem_init`. in the\n\
+latter case the memoryview or mmap's buffer is held for as long as the\n\
+Semaphore is open, so it can't be closed or unmapped underneath a\n\
+wait.",                                    /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    semaphore_methods,                         /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_semaphore_new,                      /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+
+static char *shmopen_kwargs[] = {"name", "flags", "mode", NULL};
+
+static PyObject *
+python_shm_open(PyObject *module, PyObject *args, PyObject *kwargs) {
+    char *name;
+    int flags = 0, fd;
+    unsigned int mode = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iI", shmopen_kwargs,
+                &name, &flags, &mode))
+        return NULL;
+
+    if ((fd = shm_open(name, flags, (mode_t)mode)) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)fd);
+}
+
+static PyObject *
+python_shm_unlink(PyObject *module, PyObject *args) {
+    char *name;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+
+    if (shm_unlink(name) < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+/*
+ * find the 32 bit word at offset in an object supporting the buffer
+ * protocol. the buffer stays pinned until it's released, so the memory can't
+ * be unmapped out from under a wait.
+ */
+static uint32_t *
+futex_word(PyObject *obj, Py_ssize_t offset, Py_buffer *buf) {
+    if (PyObject_GetBuffer(obj, buf, PyBUF_SIMPLE) < 0)
+        return NULL;
+
+    if (offset < 0 || offset % 4 || offset + 4 > buf->len) {
+        PyBuffer_Release(buf);
+        PyErr_SetString(PyExc_ValueError,
+                "offset must be 4 byte aligned and within the buffer");
+        return NULL;
+    }
+
+    return (uint32_t *)((char *)buf->buf + offset);
+}
+
+static char *futexwait_kwargs[] = {"buf", "offset", "expected", "timeout",
+    NULL};
+
+static PyObject *
+python_futex_wait(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset;
+    unsigned int expected;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep = NULL;
+    Py_buffer buf;
+    uint32_t *word;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OnI|d", futexwait_kwargs,
+                &obj, &offset, &expected, &timeout))
+        return NULL;
+
+    if (NULL == (word = futex_word(obj, offset, &buf)))
+        return NULL;
+
+    if (timeout >= 0) {
+        clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+        deadlinep = &deadline;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rc = futex_wait_word(word, (uint32_t)expected, deadlinep);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&buf);
+
+    if (rc < 0) {
+        /* as with any other early return, the caller rechecks the word */
+        if (EINTR == errno) {
+            if (PyErr_CheckSignals())
+                return NULL;
+        } else {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+    }
+
+    return PyBool_FromLong(rc <= 0);
+}
+
+static char *futexwake_kwargs[] = {"buf", "offset", "count", NULL};
+
+static PyObject *
+python_futex_wake(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset;
+    int count = 1, woken;
+    Py_buffer buf;
+    uint32_t *word;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|i", futexwake_kwargs,
+                &obj, &offset, &count))
+        return NULL;
+
+    if (NULL == (word = futex_word(obj, offset, &buf)))
+        return NULL;
+
+    woken = futex_wake_word(word, count);
+    PyBuffer_Release(&buf);
+
+    if (woken < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return PyInt_FromLong((long)woken);
+}
+
+#ifndef FUTEX_WAITV_MISSING
+static char *futexwaitv_kwargs[] = {"waiters", "timeout", NULL};
+
+static PyObject *
+python_futex_waitv(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *waiters, *seq, *item, *obj;
+    Py_ssize_t count, i, pinned = 0, offset;
+    unsigned int expected;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep = NULL;
+    struct futex_waitv waitv[FUTEX_WAITV_MAX];
+    Py_buffer bufs[FUTEX_WAITV_MAX];
+    uint32_t *word;
+    long rc;
+    PyObject *result = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d", futexwaitv_kwargs,
+                &waiters, &timeout))
+        return NULL;
+
+    if (NULL == (seq = PySequence_Fast(waiters,
+                    "waiters must be a sequence")))
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (!count || count > FUTEX_WAITV_MAX) {
+        PyErr_SetString(PyExc_ValueError, "between 1 and 128 waiters needed");
+        goto done;
+    }
+
+    for (; pinned < count; ++pinned) {
+        item = PySequence_Fast_GET_ITEM(seq, pinned);
+        if (!PyArg_ParseTuple(item, "OnI", &obj, &offset, &expected))
+            goto done;
+        if (NULL == (word = futex_word(obj, offset, &bufs[pinned])))
+            goto done;
+        waitv[pinned].val = expected;
+        waitv[pinned].uaddr = (uintptr_t)word;
+        waitv[pinned].flags = FUTEX_32;
+        waitv[pinned].__reserved = 0;
+    }
+
+    if (timeout >= 0) {
+        clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+        deadlinep = &deadline;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rc = syscall(SYS_futex_waitv, waitv, (unsigned int)count, 0, deadlinep,
+            CLOCK_MONOTONIC);
+    Py_END_ALLOW_THREADS
+
+    if (rc < 0 && EAGAIN == errno) {
+        /* nothing waited. report a word that had already changed */
+        for (rc = 0; rc < count - 1; ++rc)
+            if (*(uint32_t *)(uintptr_t)waitv[rc].uaddr != waitv[rc].val)
+                break;
+    }
+
+    if (rc >= 0)
+        result = PyInt_FromLong(rc);
+    else if (ETIMEDOUT == errno) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    } else if (EINTR == errno) {
+        if (!PyErr_CheckSignals())
+            result = PyInt_FromLong(-1);
+    } else
+        PyErr_SetFromErrno(PyExc_OSError);
+
+done:
+    for (i = 0; i < pinned; ++i)
+        PyBuffer_Release(&bufs[i]);
+    Py_DECREF(seq);
+    return result;
+}
+#endif
+
+
+/*
+ * process-shared pthread locks
+ *
+ * these live at an offset into the same kinds of memory as unnamed
+ * semaphores. memory found through the buffer protocol is pinned for the
+ * length of each call, a plain integer is taken as an address as is.
+ */
+
+#define SYNC_MUTEX  0
+#define SYNC_RDLOCK 1
+#define SYNC_WRLOCK 2
+
+static void *
+find_sync_ptr(PyObject *obj, Py_ssize_t offset, size_t size, Py_buffer *buf) {
+    void *ptr;
+
+    buf->obj = NULL;
+
+    if (PyInt_Check(obj) || PyLong_Check(obj)) {
+        if (find_sem_ptr(obj, &ptr) < 0)
+            return NULL;
+        ptr = (char *)ptr + offset;
+    } else {
+        if (PyObject_GetBuffer(obj, buf, PyBUF_WRITABLE) < 0)
+            return NULL;
+        if (offset < 0 || offset + (Py_ssize_t)size > buf->len) {
+            PyBuffer_Release(buf);
+            PyErr_SetString(PyExc_ValueError, "offset is out of range");
+            return NULL;
+        }
+        ptr = (char *)buf->buf + offset;
+    }
+
+    if ((uintptr_t)ptr % sizeof(long)) {
+        PyBuffer_Release(buf);
+        PyErr_SetString(PyExc_ValueError, "lock location is misaligned");
+        return NULL;
+    }
+
+    return ptr;
+}
+
+static PyObject *
+sync_result(int rc) {
+    if (rc) {
+        errno = rc;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static int
+sync_trylock(void *lock, int kind) {
+    switch (kind) {
+    case SYNC_MUTEX:
+        return pthread_mutex_trylock((pthread_mutex_t *)lock);
+    case SYNC_RDLOCK:
+        return pthread_rwlock_tryrdlock((pthread_rwlock_t *)lock);
+    default:
+        return pthread_rwlock_trywrlock((pthread_rwlock_t *)lock);
+    }
+}
+
+/* called without the GIL */
+static int
+sync_lock(void *lock, int kind, const struct timespec *deadline) {
+    if (NULL == deadline) {
+        switch (kind) {
+        case SYNC_MUTEX:
+            return pthread_mutex_lock((pthread_mutex_t *)lock);
+        case SYNC_RDLOCK:
+            return pthread_rwlock_rdlock((pthread_rwlock_t *)lock);
+        default:
+            return pthread_rwlock_wrlock((pthread_rwlock_t *)lock);
+        }
+    }
+
+    switch (kind) {
+#ifdef PTHREAD_CLOCKLOCK_MISSING
+    case SYNC_MUTEX:
+        return pthread_mutex_timedlock((pthread_mutex_t *)lock, deadline);
+    case SYNC_RDLOCK:
+        return pthread_rwlock_timedrdlock((pthread_rwlock_t *)lock, deadline);
+    default:
+        return pthread_rwlock_timedwrlock((pthread_rwlock_t *)lock, deadline);
+#else
+    case SYNC_MUTEX:
+        return pthread_mutex_clocklock((pthread_mutex_t *)lock,
+                CLOCK_MONOTONIC, deadline);
+    case SYNC_RDLOCK:
+        return pthread_rwlock_clockrdlock((pthread_rwlock_t *)lock,
+                CLOCK_MONOTONIC, deadline);
+    default:
+        return pthread_rwlock_clockwrlock((pthread_rwlock_t *)lock,
+                CLOCK_MONOTONIC, deadline);
+#endif
+    }
+}
+
+static char *synclock_kwargs[] = {"lock", "offset", "try", "timeout", NULL};
+
+static PyObject *
+sync_lock_python(int kind, PyObject *args, PyObject *kwargs) {
+    PyObject *obj, *pytry = Py_False;
+    Py_ssize_t offset = 0;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep = NULL;
+    Py_buffer buf;
+    void *lock;
+    int rc, ownerdead = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|nOd", synclock_kwargs,
+                &obj, &offset, &pytry, &timeout))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, SYNC_MUTEX == kind ?
+                    sizeof(pthread_mutex_t) : sizeof(pthread_rwlock_t),
+                    &buf)))
+        return NULL;
+
+    /* only give up the GIL if it's going to take a while */
+    if (EBUSY == (rc = sync_trylock(lock, kind)) && !PyObject_IsTrue(pytry)) {
+        if (timeout >= 0) {
+#ifdef PTHREAD_CLOCKLOCK_MISSING
+            abs_timespec_ify(timeout, &deadline);
+#else
+            clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+#endif
+            deadlinep = &deadline;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        rc = sync_lock(lock, kind, deadlinep);
+        Py_END_ALLOW_THREADS
+    }
+
+    /* a robust mutex whose owner died is ours now, but the data it protects
+     * may be half updated. mark it usable again and let the caller know. */
+    if (EOWNERDEAD == rc) {
+        ownerdead = 1;
+        rc = pthread_mutex_consistent((pthread_mutex_t *)lock);
+    }
+
+    PyBuffer_Release(&buf);
+
+    if (rc) {
+        errno = rc;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    if (SYNC_MUTEX == kind)
+        return PyBool_FromLong(ownerdead);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *sync_kwargs[] = {"lock", "offset", NULL};
+
+static PyObject *
+python_mutex_init(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    pthread_mutexattr_t attr;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_mutex_t),
+                    &buf)))
+        return NULL;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    rc = pthread_mutex_init((pthread_mutex_t *)lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_mutex_lock(PyObject *module, PyObject *args, PyObject *kwargs) {
+    return sync_lock_python(SYNC_MUTEX, args, kwargs);
+}
+
+static PyObject *
+python_mutex_unlock(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_mutex_t),
+                    &buf)))
+        return NULL;
+
+    rc = pthread_mutex_unlock((pthread_mutex_t *)lock);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_mutex_destroy(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_mutex_t),
+                    &buf)))
+        return NULL;
+
+    rc = pthread_mutex_destroy((pthread_mutex_t *)lock);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_cond_init(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    pthread_condattr_t attr;
+    Py_buffer buf;
+    void *cond;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (cond = find_sync_ptr(obj, offset, sizeof(pthread_cond_t),
+                    &buf)))
+        return NULL;
+
+    /* timed waits then measure on CLOCK_MONOTONIC */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    rc = pthread_cond_init((pthread_cond_t *)cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static char *condwait_kwargs[] = {"cond", "offset", "mutex", "mutex_offset",
+    "timeout", NULL};
+
+static PyObject *
+python_cond_wait(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *pycond, *pymutex;
+    Py_ssize_t offset, mutex_offset = 0;
+    double timeout = -1;
+    struct timespec deadline;
+    Py_buffer condbuf, mutexbuf;
+    void *cond, *mutex;
+    int rc, ownerdead = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OnO|nd", condwait_kwargs,
+                &pycond, &offset, &pymutex, &mutex_offset, &timeout))
+        return NULL;
+
+    if (NULL == (cond = find_sync_ptr(pycond, offset, sizeof(pthread_cond_t),
+                    &condbuf)))
+        return NULL;
+
+    if (NULL == (mutex = find_sync_ptr(pymutex, mutex_offset,
+                    sizeof(pthread_mutex_t), &mutexbuf))) {
+        PyBuffer_Release(&condbuf);
+        return NULL;
+    }
+
+    if (timeout >= 0) {
+        clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+        Py_BEGIN_ALLOW_THREADS
+        rc = pthread_cond_timedwait((pthread_cond_t *)cond,
+                (pthread_mutex_t *)mutex, &deadline);
+        Py_END_ALLOW_THREADS
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        rc = pthread_cond_wait((pthread_cond_t *)cond,
+                (pthread_mutex_t *)mutex);
+        Py_END_ALLOW_THREADS
+    }
+
+    /* the mutex is ours again either way, same as for mutex_lock */
+    if (EOWNERDEAD == rc) {
+        ownerdead = 1;
+        rc = pthread_mutex_consistent((pthread_mutex_t *)mutex);
+    }
+
+    PyBuffer_Release(&mutexbuf);
+    PyBuffer_Release(&condbuf);
+
+    if (rc && ETIMEDOUT != rc) {
+        errno = rc;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NN)", PyBool_FromLong(!rc),
+            PyBool_FromLong(ownerdead));
+}
+
+static PyObject *
+cond_signal_python(PyObject *args, PyObject *kwargs, int broadcast) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *cond;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (cond = find_sync_ptr(obj, offset, sizeof(pthread_cond_t),
+                    &buf)))
+        return NULL;
+
+    if (broadcast)
+        rc = pthread_cond_broadcast((pthread_cond_t *)cond);
+    else
+        rc = pthread_cond_signal((pthread_cond_t *)cond);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_cond_signal(PyObject *module, PyObject *args, PyObject *kwargs) {
+    return cond_signal_python(args, kwargs, 0);
+}
+
+static PyObject *
+python_cond_broadcast(PyObject *module, PyObject *args, PyObject *kwargs) {
+    return cond_signal_python(args, kwargs, 1);
+}
+
+static PyObject *
+python_cond_destroy(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *cond;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (cond = find_sync_ptr(obj, offset, sizeof(pthread_cond_t),
+                    &buf)))
+        return NULL;
+
+    rc = pthread_cond_destroy((pthread_cond_t *)cond);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static char *rwlockinit_kwargs[] = {"lock", "offset", "prefer_writers", NULL};
+
+static PyObject *
+python_rwlock_init(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj, *pywriters = Py_False;
+    Py_ssize_t offset = 0;
+    pthread_rwlockattr_t attr;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|nO", rwlockinit_kwargs,
+                &obj, &offset, &pywriters))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_rwlock_t),
+                    &buf)))
+        return NULL;
+
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    if (PyObject_IsTrue(pywriters))
+        pthread_rwlockattr_setkind_np(&attr,
+                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    rc = pthread_rwlock_init((pthread_rwlock_t *)lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_rwlock_rdlock(PyObject *module, PyObject *args, PyObject *kwargs) {
+    return sync_lock_python(SYNC_RDLOCK, args, kwargs);
+}
+
+static PyObject *
+python_rwlock_wrlock(PyObject *module, PyObject *args, PyObject *kwargs) {
+    return sync_lock_python(SYNC_WRLOCK, args, kwargs);
+}
+
+static PyObject *
+python_rwlock_unlock(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_rwlock_t),
+                    &buf)))
+        return NULL;
+
+    rc = pthread_rwlock_unlock((pthread_rwlock_t *)lock);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+static PyObject *
+python_rwlock_destroy(PyObject *module, PyObject *args, PyObject *kwargs) {
+    PyObject *obj;
+    Py_ssize_t offset = 0;
+    Py_buffer buf;
+    void *lock;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|n", sync_kwargs, &obj,
+                &offset))
+        return NULL;
+
+    if (NULL == (lock = find_sync_ptr(obj, offset, sizeof(pthread_rwlock_t),
+                    &buf)))
+        return NULL;
+
+    rc = pthread_rwlock_destroy((pthread_rwlock_t *)lock);
+
+    PyBuffer_Release(&buf);
+    return sync_result(rc);
+}
+
+/*
+ * create (when size isn't 0) or open a named shared memory segment and map
+ * all of it read/write. NULL with an exception set on failure, and a segment
+ * this created is removed again.
+ */
+static void *
+shm_map(const char *name, size_t size, mode_t mode, size_t *mapsize) {
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (size) {
+        if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, mode)) < 0) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        st.st_size = size;
+        if (ftruncate(fd, st.st_size) < 0)
+            goto fail;
+    } else {
+        if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return NULL;
+        }
+        if (fstat(fd, &st) < 0)
+            goto fail;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == map)
+        goto fail;
+
+    close(fd);
+    *mapsize = st.st_size;
+    return map;
+
+fail:
+    PyErr_SetFromErrno(PyExc_OSError);
+    close(fd);
+    if (size) shm_unlink(name);
+    return NULL;
+}
+
+
+/*
+ * Ring objects
+ *
+ * a single producer, single consumer ring of variable length records in a
+ * named shared memory segment. the header keeps what each side writes on
+ * its own cache line: the producer's head and the futex word it bumps to
+ * wake the consumer, then the consumer's tail and the word for waking the
+ * producer. each side only goes to the futex when the ring is empty or full,
+ * and only wakes the other when its waiting flag is up.
+ *
+ * records are a 4 byte length then the payload, padded to 8 bytes. one that
+ * won't fit before the end of the buffer is preceded by a RING_WRAP length
+ * and placed at the start instead, so every record is contiguous.
+ */
+
+#define RING_MAGIC 0x676e6972
+#define RING_WRAP 0xffffffff
+#define RING_CACHELINE 64
+#define RING_FRAME(size) (((size_t)(size) + 4 + 7) & ~(size_t)7)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t capacity;
+    char pad0[RING_CACHELINE - 8];
+
+    uint64_t head;
+    uint32_t data_seq;
+    uint32_t producer_waiting;
+    char pad1[RING_CACHELINE - 16];
+
+    uint64_t tail;
+    uint32_t space_seq;
+    uint32_t consumer_waiting;
+    char pad2[RING_CACHELINE - 16];
+} ring_header;
+
+typedef struct {
+    PyObject_HEAD
+    ring_header *header;
+    char *data;
+    size_t mapsize;
+    uint32_t capacity;
+
+    /* the other side's index as last seen */
+    uint64_t cached_head;
+    uint64_t cached_tail;
+
+    /* the open reservation and the peeked record */
+    int reserved;
+    uint64_t reserve_pos;
+    uint32_t reserve_skip;
+    uint32_t reserve_size;
+    int peeked;
+    uint32_t peek_skip;
+    uint32_t peek_size;
+
+    /* what the next memoryview will cover */
+    char *view;
+    Py_ssize_t viewsize;
+    int viewreadonly;
+    int exports;
+} python_ring_object;
+
+static char *ring_kwargs[] = {"name", "capacity", "mode", NULL};
+
+static PyObject *
+python_ring_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_ring_object *self;
+    char *name;
+    unsigned int capacity = 0, mode = 0600;
+    void *map;
+    ring_header *header;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|II", ring_kwargs,
+                &name, &capacity, &mode))
+        return NULL;
+
+    if (capacity && (capacity < RING_CACHELINE || capacity > 0x80000000 ||
+                capacity & (capacity - 1))) {
+        PyErr_SetString(PyExc_ValueError,
+                "capacity must be a power of two, at least 64");
+        return NULL;
+    }
+
+    if (!(self = (python_ring_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->header = NULL;
+    self->reserved = self->peeked = 0;
+    self->view = NULL;
+    self->exports = 0;
+
+    if (NULL == (map = shm_map(name,
+                    capacity ? sizeof(ring_header) + capacity : 0,
+                    (mode_t)mode, &self->mapsize))) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    header = (ring_header *)map;
+    self->header = header;
+    self->data = (char *)map + sizeof(ring_header);
+
+    if (capacity) {
+        header->capacity = capacity;
+        __atomic_store_n(&header->magic, RING_MAGIC, __ATOMIC_RELEASE);
+    } else if (self->mapsize < sizeof(ring_header) ||
+            __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != RING_MAGIC ||
+            sizeof(ring_header) + header->capacity != self->mapsize) {
+        PyErr_SetString(PyExc_ValueError, "shm segment isn't a Ring");
+        Py_DECREF(self);
+        return NULL;
+    }
+    self->capacity = header->capacity;
+    self->cached_head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    self->cached_tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+
+    return (PyObject *)self;
+}
+
+static void
+python_ring_dealloc(python_ring_object *self) {
+    if (NULL != self->header)
+        munmap(self->header, self->mapsize);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+ring_check(python_ring_object *self) {
+    if (NULL == self->header) {
+        PyErr_SetString(PyExc_ValueError, "Ring is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* refresh the view of the other side's index, returning the producer's free
+ * space or the consumer's pending bytes */
+static uint64_t
+ring_available(python_ring_object *self, int producer) {
+    ring_header *header = self->header;
+
+    if (producer) {
+        self->cached_tail = __atomic_load_n(&header->tail, __ATOMIC_SEQ_CST);
+        return self->capacity - (header->head - self->cached_tail);
+    }
+    self->cached_head = __atomic_load_n(&header->head, __ATOMIC_SEQ_CST);
+    return self->cached_head - header->tail;
+}
+
+/*
+ * wait until ring_available() reaches need. the waiting flag goes up before
+ * the index is checked again, and the other side moves its index before
+ * checking the flag, so one of the two always sees the other.
+ *
+ * 1 once there's enough, 0 on timeout, -1 with an exception set
+ */
+static int
+ring_wait(python_ring_object *self, int producer, uint64_t need,
+        double timeout) {
+    ring_header *header = self->header;
+    uint32_t *seq = producer ? &header->space_seq : &header->data_seq;
+    uint32_t *waiting = producer ?
+        &header->producer_waiting : &header->consumer_waiting;
+    struct timespec deadline, *deadlinep = NULL;
+    uint32_t expected;
+    int rc;
+
+    if (ring_available(self, producer) >= need)
+        return 1;
+    if (0 == timeout)
+        return 0;
+
+    if (timeout > 0) {
+        clock_timespec_ify(CLOCK_MONOTONIC, timeout, &deadline);
+        deadlinep = &deadline;
+    }
+
+    while (1) {
+        expected = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (ring_available(self, producer) >= need) {
+            rc = 1;
+            break;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        rc = futex_wait_word(seq, expected, deadlinep);
+        Py_END_ALLOW_THREADS
+
+        if (rc > 0) {
+            rc = ring_available(self, producer) >= need;
+            break;
+        }
+        if (rc < 0) {
+            if (EINTR == errno && !PyErr_CheckSignals())
+                continue;
+            if (!PyErr_Occurred())
+                PyErr_SetFromErrno(PyExc_OSError);
+            break;
+        }
+    }
+
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    return rc;
+}
+
+/* after moving our index, wake the other side if it's waiting on it */
+static void
+ring_signal(uint32_t *seq, uint32_t *waiting) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(seq, 1, __ATOMIC_RELEASE);
+        futex_wake_word(seq, 1);
+    }
+}
+
+static PyObject *
+ring_view(python_ring_object *self, char *view, size_t size, int readonly) {
+    PyObject *memview;
+
+    self->view = view;
+    self->viewsize = (Py_ssize_t)size;
+    self->viewreadonly = readonly;
+    memview = PyMemoryView_FromObject((PyObject *)self);
+    self->view = NULL;
+
+    return memview;
+}
+
+static char *ring_reserve_kwargs[] = {"size", "timeout", NULL};
+
+static PyObject *
+python_ring_reserve(python_ring_object *self, PyObject *args,
+        PyObject *kwargs) {
+    Py_ssize_t size;
+    double timeout = -1;
+    uint64_t head;
+    size_t frame, offset, skip;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|d", ring_reserve_kwargs,
+                &size, &timeout))
+        return NULL;
+
+    if (ring_check(self))
+        return NULL;
+
+    /* capping records at half the ring means one that has to wrap still
+     * fits behind the unused end */
+    frame = RING_FRAME(size);
+    if (size < 0 || frame > self->capacity / 2) {
+        PyErr_SetString(PyExc_ValueError, "record too large for the Ring");
+        return NULL;
+    }
+
+    head = __atomic_load_n(&self->header->head, __ATOMIC_RELAXED);
+    offset = head & (self->capacity - 1);
+    skip = frame > self->capacity - offset ? self->capacity - offset : 0;
+
+    if (self->capacity - (head - self->cached_tail) < skip + frame) {
+        if ((rc = ring_wait(self, 1, skip + frame, timeout)) < 0)
+            return NULL;
+        if (!rc) {
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+    }
+
+    self->reserved = 1;
+    self->reserve_pos = head;
+    self->reserve_skip = (uint32_t)skip;
+    self->reserve_size = (uint32_t)size;
+
+    return ring_view(self, self->data + (skip ? 0 : offset) + 4, size, 0);
+}
+
+static char *ring_commit_kwargs[] = {"size", NULL};
+
+static PyObject *
+python_ring_commit(python_ring_object *self, PyObject *args,
+        PyObject *kwargs) {
+    Py_ssize_t size = -1;
+    uint64_t pos;
+    uint32_t mask;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", ring_commit_kwargs,
+                &size))
+        return NULL;
+
+    if (ring_check(self))
+        return NULL;
+
+    if (!self->reserved) {
+        PyErr_SetString(PyExc_ValueError, "nothing reserved to commit");
+        return NULL;
+    }
+    if (size < 0)
+        size = self->reserve_size;
+    else if (size > self->reserve_size) {
+        PyErr_SetString(PyExc_ValueError, "size is larger than reserved");
+        return NULL;
+    }
+
+    pos = self->reserve_pos;
+    mask = self->capacity - 1;
+    if (self->reserve_skip) {
+        *(uint32_t *)(self->data + (pos & mask)) = RING_WRAP;
+        pos += self->reserve_skip;
+    }
+    *(uint32_t *)(self->data + (pos & mask)) = (uint32_t)size;
+
+    __atomic_store_n(&self->header->head, pos + RING_FRAME(size),
+            __ATOMIC_RELEASE);
+    self->reserved = 0;
+
+    ring_signal(&self->header->data_seq, &self->header->consumer_waiting);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *ring_peek_kwargs[] = {"timeout", NULL};
+
+static PyObject *
+python_ring_peek(python_ring_object *self, PyObject *args, PyObject *kwargs) {
+    double timeout = -1;
+    uint64_t tail;
+    size_t offset;
+    uint32_t size, skip = 0;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|d", ring_peek_kwargs,
+                &timeout))
+        return NULL;
+
+    if (ring_check(self))
+        return NULL;
+
+    tail = __atomic_load_n(&self->header->tail, __ATOMIC_RELAXED);
+
+    if (!self->peeked && self->cached_head == tail) {
+        if ((rc = ring_wait(self, 0, 1, timeout)) < 0)
+            return NULL;
+        if (!rc) {
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+    }
+
+    offset = tail & (self->capacity - 1);
+    size = *(uint32_t *)(self->data + offset);
+    if (RING_WRAP == size) {
+        skip = self->capacity - offset;
+        offset = 0;
+        size = *(uint32_t *)self->data;
+    }
+
+    self->peeked = 1;
+    self->peek_skip = skip;
+    self->peek_size = size;
+
+    return ring_view(self, self->data + offset + 4, size, 1);
+}
+
+static PyObject *
+python_ring_release(python_ring_object *self, PyObject *iamnull) {
+    uint64_t tail;
+
+    if (ring_check(self))
+        return NULL;
+
+    if (!self->peeked) {
+        PyErr_SetString(PyExc_ValueError, "no peeked record to release");
+        return NULL;
+    }
+
+    tail = __atomic_load_n(&self->header->tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->header->tail,
+            tail + self->peek_skip + RING_FRAME(self->peek_size),
+            __ATOMIC_RELEASE);
+    self->peeked = 0;
+
+    ring_signal(&self->header->space_seq, &self->header->producer_waiting);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+python_ring_close(python_ring_object *self, PyObject *iamnull) {
+    if (self->exports) {
+        PyErr_SetString(PyExc_BufferError,
+                "cannot close a Ring with views still in use");
+        return NULL;
+    }
+
+    if (NULL != self->header && munmap(self->header, self->mapsize) < 0) {
+        self->header = NULL;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->header = NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static Py_ssize_t
+python_ring_length(python_ring_object *self) {
+    if (ring_check(self))
+        return -1;
+
+    return (Py_ssize_t)(__atomic_load_n(&self->header->head, __ATOMIC_ACQUIRE)
+            - __atomic_load_n(&self->header->tail, __ATOMIC_ACQUIRE));
+}
+
+static int
+python_ring_getbuf(python_ring_object *self, Py_buffer *buf, int flags) {
+    if (NULL == self->view) {
+        PyErr_SetString(PyExc_BufferError,
+                "Ring memory is only viewable through reserve() and peek()");
+        buf->obj = NULL;
+        return -1;
+    }
+
+    if (PyBuffer_FillInfo(buf, (PyObject *)self, self->view, self->viewsize,
+                self->viewreadonly, flags) < 0)
+        return -1;
+
+    self->exports++;
+    return 0;
+}
+
+static void
+python_ring_releasebuf(python_ring_object *self, Py_buffer *buf) {
+    self->exports--;
+}
+
+static PyBufferProcs python_ringbuf = {
+#if PY_MAJOR_VERSION < 3
+    0,
+    0,
+    0,
+    0,
+#endif
+    (getbufferproc)python_ring_getbuf,
+    (releasebufferproc)python_ring_releasebuf
+};
+
+static PySequenceMethods ring_as_sequence = {
+    (lenfunc)python_ring_length,               /* sq_length */
+};
+
+static PyMethodDef ring_methods[] = {
+    {"reserve", (PyCFunction)python_ring_reserve,
+        METH_VARARGS | METH_KEYWORDS,
+        "reserve space for the next record (producer side)\n\
+\n\
+nothing is visible to the consumer until :meth:`commit`. reserving again\n\
+before that abandons the earlier reservation.\n\
+\n\
+:param int size:\n\
+    the record size in bytes. records can take up at most half the ring's\n\
+    capacity, including a 4 byte length and padding to 8 bytes.\n\
+\n\
+:param float timeout:\n\
+    the longest to wait for the consumer to make room, in seconds. negative\n\
+    (the default) waits indefinitely, 0 doesn't wait at all.\n\
+\n\
+:returns:\n\
+    a writable memoryview of ``size`` bytes directly in the shared memory,\n\
+    or None if the timeout ran out first\n\
+"},
+    {"commit", (PyCFunction)python_ring_commit,
+        METH_VARARGS | METH_KEYWORDS,
+        "publish the reserved record to the consumer\n\
+\n\
+:param int size:\n\
+    optionally shrink the record to this many bytes, returning the rest of\n\
+    the reservation to the ring. defaults to the reserved size.\n\
+"},
+    {"peek", (PyCFunction)python_ring_peek, METH_VARARGS | METH_KEYWORDS,
+        "get the next record without consuming it (consumer side)\n\
+\n\
+it stays in the ring, and further peeks return it again, until\n\
+:meth:`release`.\n\
+\n\
+:param float timeout:\n\
+    the longest to wait for a record, in seconds. negative (the default)\n\
+    waits indefinitely, 0 doesn't wait at all.\n\
+\n\
+:returns:\n\
+    a read-only memoryview of the record directly in the shared memory, or\n\
+    None if the timeout ran out first\n\
+"},
+    {"release", (PyCFunction)python_ring_release, METH_NOARGS,
+        "consume the peeked record, freeing its space for the producer\n\
+\n\
+memoryviews of the record must not be used after this.\n\
+"},
+    {"close", (PyCFunction)python_ring_close, METH_NOARGS,
+        "unmap the shared memory\n\
+\n\
+the segment itself stays until it's removed with :func:`shm_unlink`.\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_ring_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_ipc.Ring",                  /* tp_name */
+    sizeof(python_ring_object),                /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_ring_dealloc,           /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &ring_as_sequence,                         /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    &python_ringbuf,                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT |
+#if PY_MAJOR_VERSION < 3
+    Py_TPFLAGS_HAVE_NEWBUFFER,                 /* tp_flags */
+#else
+    0,                                         /* tp_flags */
+#endif
+    "Ring(name, capacity=0, mode=0600)\n\
+\n\
+a single producer, single consumer ring buffer of byte records in a named\n\
+shared memory segment\n\
+\n\
+with a ``capacity`` (a power of two, at least 64) the segment is created,\n\
+failing if it already exists, otherwise an existing one is opened. one\n\
+process (or thread) produces with :meth:`reserve` and :meth:`commit`, one\n\
+consumes with :meth:`peek` and :meth:`release`, and neither makes a system\n\
+call unless it has to wait on the other.\n\
+\n\
+``len()`` is the number of bytes of records currently in the ring.",
+                                               /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    ring_methods,                              /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_ring_new,                           /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+/*
+ * ShmQueue objects
+ *
+ * a bounded multi-producer, multi-consumer queue of fixed size slots in a
+ * named shared memory segment, after Dmitry Vyukov's design. each slot has
+ * a sequence number saying whose turn it is: a sender may claim slot
+ * pos & mask when its sequence is pos, a receiver when it's pos + 1. claims
+ * are a compare-and-swap on the shared enqueue or dequeue position, so
+ * neither side takes a lock or makes a system call unless it has to wait.
+ *
+ * waiters count themselves in before the final check and sleep on a futex
+ * word that the other side bumps only when it sees a nonzero count.
+ */
+
+#define SHMQUEUE_MAGIC 0x756575716d6873ULL
+
+typedef struct {
+    uint64_t magic;
+    uint32_t slots;
+    uint32_t slotsize;
+    uint32_t cellsize;
+    char pad0[RING_CACHELINE - 20];
+
+    uint64_t enqueue_pos;
+    char pad1[RING_CACHELINE - 8];
+
+    uint64_t dequeue_pos;
+    char pad2[RING_CACHELINE - 8];
+
+    uint32_t data_seq;
+    uint32_t receivers_waiting;
+    uint32_t space_seq;
+    uint32_t senders_waiting;
+    char pad3[RING_CACHELINE - 16];
+} shmqueue_header;
+
+typedef struct {
+    uint64_t seq;
+    uint32_t size;
+    uint32_t pad;
+    char data[1];
+} shmqueue_cell;
+
+#define SHMQUEUE_CELLSIZE(slotsize) \
+    ((offsetof(shmqueue_cell, data) + (size_t)(slotsize) + 7) & ~(size_t)7)
+
+typedef struct {
+    PyObject_HEAD
+    shmqueue_header *header;
+    char *cells;
+    size_t mapsize;
+    uint64_t mask;
+    uint32_t slotsize;
+    uint32_t cellsize;
+} python_shmqueue_object;
+
+static char *shmqueue_kwargs[] = {"name", "slots", "slotsize", "mode", NULL};
+
+static PyObject *
+python_shmqueue_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_shmqueue_object *self;
+    char *name;
+    unsigned int slots = 0, slotsize = 0, mode = 0600, i;
+    size_t cellsize = 0;
+    shmqueue_header *header;
+    shmqueue_cell *cell;
+    void *map;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|III", shmqueue_kwargs,
+                &name, &slots, &slotsize, &mode))
+        return NULL;
+
+    if (slots) {
+        if (slots < 2 || slots > 0x80000000 || slots & (slots - 1)) {
+            PyErr_SetString(PyExc_ValueError,
+                    "slots must be a power of two, at least 2");
+            return NULL;
+        }
+        if (!slotsize || slotsize > 0x7fffffff) {
+            PyErr_SetString(PyExc_ValueError, "a slotsize is required");
+            return NULL;
+        }
+        cellsize = SHMQUEUE_CELLSIZE(slotsize);
+    }
+
+    if (!(self = (python_shmqueue_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->header = NULL;
+
+    if (NULL == (map = shm_map(name,
+                    slots ? sizeof(shmqueue_header) + cellsize * slots : 0,
+                    (mode_t)mode, &self->mapsize))) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    header = (shmqueue_header *)map;
+    self->header = header;
+    self->cells = (char *)map + sizeof(shmqueue_header);
+
+    if (slots) {
+        header->slots = slots;
+        header->slotsize = slotsize;
+        header->cellsize = (uint32_t)cellsize;
+        for (i = 0; i < slots; ++i) {
+            cell = (shmqueue_cell *)(self->cells + cellsize * i);
+            cell->seq = i;
+        }
+        __atomic_store_n(&header->magic, SHMQUEUE_MAGIC, __ATOMIC_RELEASE);
+    } else if (self->mapsize < sizeof(shmqueue_header) ||
+            __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+                SHMQUEUE_MAGIC ||
+            sizeof(shmqueue_header) + (size_t)header->cellsize *
+                header->slots != self->mapsize) {
+        PyErr_SetString(PyExc_ValueError, "shm segment isn't a ShmQueue");
+        Py_DECREF(self);
+        return NULL;
+    }
+    self->mask = header->slots - 1;
+    self->slotsize = header->slotsize;
+    self->cellsize = header->cellsize;
+
+    return (PyObject *)self;
+}
+
+static void
+python_shmqueue_dealloc(python_shmqueue_object *self) {
+    if (NULL != self->header)
+        munmap(self->header, self->mapsize);
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+shmqueue_check(python_shmqueue_object *self) {
+    if (NULL == self->header) {
+        PyErr_SetString(PyExc_ValueError, "ShmQueue is closed");
+        return -1;
+    }
+    return 0;
+}
+
+#define SHMQUEUE_CELL(self, pos) \
+    ((shmqueue_cell *)((self)->cells + (self)->cellsize * ((pos) & (self)->mask)))
+
+/* claim the next slot to send into or receive from. NULL if full/empty */
+static shmqueue_cell *
+shmqueue_claim(python_shmqueue_object *self, int sending, uint64_t *posp) {
+    uint64_t *shared = sending ?
+        &self->header->enqueue_pos : &self->header->dequeue_pos;
+    uint64_t pos = __atomic_load_n(shared, __ATOMIC_RELAXED);
+    shmqueue_cell *cell;
+    int64_t diff;
+
+    while (1) {
+        cell = SHMQUEUE_CELL(self, pos);
+        diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+                (pos + !sending));
+        if (!diff) {
+            if (__atomic_compare_exchange_n(shared, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *posp = pos;
+                return cell;
+            }
+        } else if (diff < 0)
+            return NULL;
+        else
+            pos = __atomic_load_n(shared, __ATOMIC_RELAXED);
+    }
+}
+
+/* could shmqueue_claim succeed right now? */
+static int
+shmqueue_ready(python_shmqueue_object *self, int sending) {
+    uint64_t pos = __atomic_load_n(sending ? &self->header->enqueue_pos :
+            &self->header->dequeue_pos, __ATOMIC_SEQ_CST);
+    shmqueue_cell *cell = SHMQUEUE_CELL(self, pos);
+
+    return (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_SEQ_CST) -
+            (pos + !sending)) >= 0;
+}
+
+/* hand a claimed slot over to the other side */
+static void
+shmqueue_publish(python_shmqueue_object *self, int sending,
+        shmqueue_cell *cell, uint64_t pos) {
+    __atomic_store_n(&cell->seq, sending ? pos + 1 : pos + self->mask + 1,
+            __ATOMIC_RELEASE);
+}
+
+/* wake up to count waiters on the other side, if there are any */
+static void
+shmqueue_signal(python_shmqueue_object *self, int sending, int count) {
+    shmqueue_header *header = self->header;
+    uint32_t *seq = sending ? &header->data_seq : &header->space_seq;
+    uint32_t *waiting = sending ?
+        &header->receivers_waiting : &header->senders_waiting;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(seq, 1, __ATOMIC_RELEASE);
+        futex_wake_word(seq, count);
+    }
+}
+
+/*
+ * sleep until a claim might succeed, or the deadline passes. 0 to try again,
+ * -1 with an exception set (including ETIMEDOUT or EAGAIN for a timeout)
+ */
+static int
+shmqueue_wait(python_shmqueue_object *self, int sending,
+        struct timespec *deadline, int nowait) {
+    shmqueue_header *header = self->header;
+    uint32_t *seq = sending ? &header->space_seq : &header->data_seq;
+    uint32_t *waiting = sending ?
+        &header->senders_waiting : &header->receivers_waiting;
+    uint32_t expected;
+    int rc = 0;
+
+    if (nowait) {
+        errno = EAGAIN;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+
+    expected = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(waiting, 1, __ATOMIC_SEQ_CST);
+    if (!shmqueue_ready(self, sending)) {
+        Py_BEGIN_ALLOW_THREADS
+        rc = futex_wait_word(seq, expected, deadline);
+        Py_END_ALLOW_THREADS
+    }
+    __atomic_fetch_sub(waiting, 1, __ATOMIC_RELAXED);
+
+    if (rc > 0) {
+        errno = ETIMEDOUT;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    if (rc < 0) {
+        if (EINTR == errno)
+            return PyErr_CheckSignals();
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+static struct timespec *
+shmqueue_deadline(double timeout, struct timespec *deadline) {
+    if (timeout <= 0)
+        return NULL;
+    clock_timespec_ify(CLOCK_MONOTONIC, timeout, deadline);
+    return deadline;
+}
+
+/* 1 if sent, 0 if full, -1 with an exception set */
+static int
+shmqueue_send_one(python_shmqueue_object *self, PyObject *msg) {
+    Py_buffer buf;
+    shmqueue_cell *cell;
+    uint64_t pos;
+
+    if (PyObject_GetBuffer(msg, &buf, PyBUF_SIMPLE) < 0)
+        return -1;
+
+    if (buf.len > self->slotsize) {
+        PyBuffer_Release(&buf);
+        errno = EMSGSIZE;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+
+    if (NULL == (cell = shmqueue_claim(self, 1, &pos))) {
+        PyBuffer_Release(&buf);
+        return 0;
+    }
+
+    cell->size = (uint32_t)buf.len;
+    memcpy(cell->data, buf.buf, buf.len);
+    shmqueue_publish(self, 1, cell, pos);
+
+    PyBuffer_Release(&buf);
+    return 1;
+}
+
+/* a received message, NULL if empty (without an exception) or on error */
+static PyObject *
+shmqueue_receive_one(python_shmqueue_object *self) {
+    shmqueue_cell *cell;
+    uint64_t pos;
+    PyObject *msg;
+
+    if (NULL == (cell = shmqueue_claim(self, 0, &pos)))
+        return NULL;
+
+    /* the slot goes back either way, so a failure here loses the message */
+    msg = PyString_FromStringAndSize(cell->data, cell->size);
+    shmqueue_publish(self, 0, cell, pos);
+
+    return msg;
+}
+
+static char *shmqueue_send_kwargs[] = {"msg", "timeout", NULL};
+
+static PyObject *
+python_shmqueue_send(python_shmqueue_object *self, PyObject *args,
+        PyObject *kwargs) {
+    PyObject *msg;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep;
+    int rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d",
+                shmqueue_send_kwargs, &msg, &timeout))
+        return NULL;
+
+    if (shmqueue_check(self))
+        return NULL;
+
+    deadlinep = shmqueue_deadline(timeout, &deadline);
+    while (!(rc = shmqueue_send_one(self, msg)))
+        if (shmqueue_wait(self, 1, deadlinep, 0 == timeout))
+            return NULL;
+    if (rc < 0)
+        return NULL;
+
+    shmqueue_signal(self, 1, 1);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char *shmqueue_receive_kwargs[] = {"timeout", NULL};
+
+static PyObject *
+python_shmqueue_receive(python_shmqueue_object *self, PyObject *args,
+        PyObject *kwargs) {
+    double timeout = -1;
+    struct timespec deadline, *deadlinep;
+    PyObject *msg;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|d",
+                shmqueue_receive_kwargs, &timeout))
+        return NULL;
+
+    if (shmqueue_check(self))
+        return NULL;
+
+    deadlinep = shmqueue_deadline(timeout, &deadline);
+    while (NULL == (msg = shmqueue_receive_one(self))) {
+        if (PyErr_Occurred())
+            break;
+        if (shmqueue_wait(self, 0, deadlinep, 0 == timeout))
+            return NULL;
+    }
+
+    shmqueue_signal(self, 0, 1);
+
+    return msg;
+}
+
+static char *shmqueue_send_many_kwargs[] = {"msgs", "timeout", NULL};
+
+static PyObject *
+python_shmqueue_send_many(python_shmqueue_object *self, PyObject *args,
+        PyObject *kwargs) {
+    PyObject *msgs, *seq;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep;
+    Py_ssize_t count, sent = 0;
+    int rc = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d",
+                shmqueue_send_many_kwargs, &msgs, &timeout))
+        return NULL;
+
+    if (shmqueue_check(self))
+        return NULL;
+
+    if (NULL == (seq = PySequence_Fast(msgs, "msgs must be a sequence")))
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    /* only waits for room for the first, then sends what fits */
+    deadlinep = shmqueue_deadline(timeout, &deadline);
+    while (sent < count) {
+        rc = shmqueue_send_one(self, PySequence_Fast_GET_ITEM(seq, sent));
+        if (rc > 0)
+            sent++;
+        else if (rc < 0 || sent ||
+                (rc = shmqueue_wait(self, 1, deadlinep, 0 == timeout)))
+            break;
+    }
+    Py_DECREF(seq);
+
+    if (sent) {
+        PyErr_Clear();
+        shmqueue_signal(self, 1, (int)sent);
+    } else if (rc < 0)
+        return NULL;
+
+    return PyInt_FromLong((long)sent);
+}
+
+static char *shmqueue_receive_many_kwargs[] = {"max", "timeout", NULL};
+
+static PyObject *
+python_shmqueue_receive_many(python_shmqueue_object *self, PyObject *args,
+        PyObject *kwargs) {
+    int max = 64;
+    double timeout = -1;
+    struct timespec deadline, *deadlinep;
+    PyObject *result, *msg;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|id",
+                shmqueue_receive_many_kwargs, &max, &timeout))
+        return NULL;
+
+    if (max <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max must be positive");
+        return NULL;
+    }
+
+    if (shmqueue_check(self))
+        return NULL;
+
+    if (NULL == (result = PyList_New(0)))
+        return NULL;
+
+    /* only waits for the first, then takes what's there */
+    deadlinep = shmqueue_deadline(timeout, &deadline);
+    while (PyList_GET_SIZE(result) < max) {
+        if (NULL == (msg = shmqueue_receive_one(self))) {
+            if (PyErr_Occurred() || PyList_GET_SIZE(result) ||
+                    shmqueue_wait(self, 0, deadlinep, 0 == timeout))
+                break;
+            continue;
+        }
+        if (PyList_Append(result, msg) < 0) {
+            Py_DECREF(msg);
+            break;
+        }
+        Py_DECREF(msg);
+    }
+
+    if (PyList_GET_SIZE(result)) {
+        PyErr_Clear();
+        shmqueue_signal(self, 0, (int)PyList_GET_SIZE(result));
+    } else if (PyErr_Occurred()) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+static PyObject *
+python_shmqueue_close(python_shmqueue_object *self, PyObject *iamnull) {
+    if (NULL != self->header && munmap(self->header, self->mapsize) < 0) {
+        self->header = NULL;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    self->header = NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static Py_ssize_t
+python_shmqueue_length(python_shmqueue_object *self) {
+    int64_t length;
+
+    if (shmqueue_check(self))
+        return -1;
+
+    /* only a snapshot, and claimed slots count before they're published */
+    length = (int64_t)(
+            __atomic_load_n(&self->header->enqueue_pos, __ATOMIC_ACQUIRE) -
+            __atomic_load_n(&self->header->dequeue_pos, __ATOMIC_ACQUIRE));
+    return length < 0 ? 0 : (Py_ssize_t)length;
+}
+
+static PySequenceMethods shmqueue_as_sequence = {
+    (lenfunc)python_shmqueue_length,           /* sq_length */
+};
+
+static PyMethodDef shmqueue_methods[] = {
+    {"send", (PyCFunction)python_shmqueue_send, METH_VARARGS | METH_KEYWORDS,
+        "put a message on the queue\n\
+\n\
+:param msg: a bytes-like object no longer than the queue's ``slotsize``\n\
+\n\
+:param float timeout:\n\
+    the longest to wait for a free slot, in seconds. negative (the default)\n\
+    waits indefinitely, and 0 fails right away with ``EAGAIN`` if the queue\n\
+    is full. otherwise fails with ``ETIMEDOUT``.\n\
+"},
+    {"receive", (PyCFunction)python_shmqueue_receive,
+        METH_VARARGS | METH_KEYWORDS,
+        "take a message off the queue\n\
+\n\
+:param float timeout:\n\
+    the longest to wait for a message, as for :meth:`send`\n\
+\n\
+:returns: the message, as a bytes object\n\
+"},
+    {"send_many", (PyCFunction)python_shmqueue_send_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "put several messages on the queue\n\
+\n\
+this only waits until the first can be sent, then sends as many of the\n\
+rest as there's room for.\n\
+\n\
+:param msgs: a sequence of bytes-like objects\n\
+\n\
+:param float timeout: as for :meth:`send`\n\
+\n\
+:returns:\n\
+    the number of messages sent, from the start of ``msgs``. an error is\n\
+    only raised if there were none.\n\
+"},
+    {"receive_many", (PyCFunction)python_shmqueue_receive_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "take several messages off the queue\n\
+\n\
+this only waits for the first message, then takes whatever others are\n\
+already there.\n\
+\n\
+:param int max: the most messages to take, defaults to 64\n\
+\n\
+:param float timeout: as for :meth:`send`\n\
+\n\
+:returns: a non-empty list of messages\n\
+"},
+    {"close", (PyCFunction)python_shmqueue_close, METH_NOARGS,
+        "unmap the shared memory\n\
+\n\
+the segment itself stays until it's removed with :func:`shm_unlink`.\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_shmqueue_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_ipc.ShmQueue",              /* tp_name */
+    sizeof(python_shmqueue_object),            /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_shmqueue_dealloc,       /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &shmqueue_as_sequence,                     /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    0,                                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                        /* tp_flags */
+    "ShmQueue(name, slots=0, slotsize=0, mode=0600)\n\
+\n\
+a bounded queue of messages in a named shared memory segment, for any\n\
+number of sending and receiving processes\n\
+\n\
+with ``slots`` (a power of two) and ``slotsize`` (the longest message) the\n\
+segment is created, failing if it already exists, otherwise an existing one\n\
+is opened. unlike a message queue, message size is only limited by the\n\
+``slotsize`` chosen here, and neither end makes a system call unless it has\n\
+to wait.\n\
+\n\
+``len()`` is roughly the number of messages waiting.",  /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    shmqueue_methods,                          /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_shmqueue_new,                       /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
+/*
+ * Seqlock objects
+ *
+ * a payload in a named shared memory segment guarded by a sequence number
+ * that's odd while a write is under way. readers copy the payload out and
+ * retry if the sequence moved meanwhile, so reading writes nothing to shared
+ * memory and makes no system calls.
+ */
+
+#define SEQLOCK_MAGIC 0x6b636f6c716573ULL
+
+typedef struct {
+    uint64_t magic;
+    uint32_t capacity;
+    char pad0[RING_CACHELINE - 12];
+
+    uint64_t seq;
+    uint32_t length;
+    char pad1[RING_CACHELINE - 12];
+} seqlock_header;
+
+typedef struct {
+    PyObject_HEAD
+    seqlock_header *header;
+    char *data;
+    size_t mapsize;
+    int writing;
+    int exports;
+    int viewable;
+} python_seqlock_object;
+
+static char *seqlock_kwargs[] = {"name", "size", "mode", NULL};
+
+static PyObject *
+python_seqlock_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    python_seqlock_object *self;
+    char *name;
+    unsigned int size = 0, mode = 0600;
+    seqlock_header *header;
+    void *map;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|II", seqlock_kwargs,
+                &name, &size, &mode))
+        return NULL;
+
+    if (size > 0x7fffffff) {
+        PyErr_SetString(PyExc_ValueError, "size is too large");
+        return NULL;
+    }
+
+    if (!(self = (python_seqlock_object *)type->tp_alloc(type, 0)))
+        return NULL;
+
+    self->header = NULL;
+    self->writing = self->exports = self->viewable = 0;
+
+    if (NULL == (map = shm_map(name, size ? sizeof(seqlock_header) + size : 0,
+                    (mode_t)mode, &self->mapsize))) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    header = (seqlock_header *)map;
+    self->header = header;
+    self->data = (char *)map + sizeof(seqlock_header);
+
+    if (size) {
+        header->capacity = size;
+        __atomic_store_n(&header->magic, SEQLOCK_MAGIC, __ATOMIC_RELEASE);
+    } else if (self->mapsize < sizeof(seqlock_header) ||
+            __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+                SEQLOCK_MAGIC ||
+            sizeof(seqlock_header) + header->capacity != self->mapsize) {
+        PyErr_SetString(PyExc_ValueError, "shm segment isn't a Seqlock");
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *)self;
+}
+
+static void seqlock_end(python_seqlock_object *self, uint32_t length);
+
+static void
+python_seqlock_dealloc(python_seqlock_object *self) {
+    if (NULL != self->header) {
+        if (self->writing)
+            seqlock_end(self, self->header->length);
+        munmap(self->header, self->mapsize);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int
+seqlock_check(python_seqlock_object *self) {
+    if (NULL == self->header) {
+        PyErr_SetString(PyExc_ValueError, "Seqlock is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* make the sequence odd. -1 with an exception if another write is going */
+static int
+seqlock_begin(python_seqlock_object *self) {
+    uint64_t seq = __atomic_load_n(&self->header->seq, __ATOMIC_RELAXED);
+
+    if (self->writing) {
+        PyErr_SetString(PyExc_ValueError, "write already begun");
+        return -1;
+    }
+
+    if (seq & 1 || !__atomic_compare_exchange_n(&self->header->seq, &seq,
+                seq + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        errno = EBUSY;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    /* nothing written to the payload may become visible before the odd
+     * sequence number does */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    self->writing = 1;
+    return 0;
+}
+
+static void
+seqlock_end(python_seqlock_object *self, uint32_t length) {
+    seqlock_header *header = self->header;
+
+    header->length = length;
+    __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELEASE);
+    self->writing = 0;
+}
+
+static PyObject *
+python_seqlock_write_begin(python_seqlock_object *self, PyObject *iamnull) {
+    PyObject *memview;
+
+    if (seqlock_check(self))
+        return NULL;
+
+    if (seqlock_begin(self))
+        return NULL;
+
+    self->viewable = 1;
+    memview = PyMemoryView_FromObject((PyObject *)self);
+    self->viewable = 0;
+
+    if (NULL == memview)
+        seqlock_end(self, self->header->length);
+    return memview;
+}
+
+static char *seqlock_write_end_kwargs[] = {"size", NULL};
+
+static PyObject *
+python_seqlock_write_end(python_seqlock_object *self, PyObject *args,
+        PyObject *kwargs) {
+    Py_ssize_t size = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n",
+                seqlock_write_end_kwargs, &size))
+        return NULL;
+
+    if (seqlock_check(self))
         return NULL;
 
-    if (find_sem_ptr(pysem, &mem) < 0)
+    if (!self->writing) {
+        PyErr_SetString(PyExc_ValueError, "no write begun");
         return NULL;
+    }
 
-    if (sem_destroy(mem) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    if (size > self->header->capacity) {
+        PyErr_SetString(PyExc_ValueError, "size is larger than the payload");
         return NULL;
     }
 
+    seqlock_end(self, size < 0 ? self->header->length : (uint32_t)size);
+
     Py_INCREF(Py_None);
     return Py_None;
 }
 
 static PyObject *
-python_sem_getvalue(PyObject *module, PyObject *args) {
-    PyObject *pysem;
-    sem_t *semp;
-    int val;
+python_seqlock_write(python_seqlock_object *self, PyObject *data) {
+    Py_buffer buf;
 
-    if (!PyArg_ParseTuple(args, "O", &pysem))
+    if (seqlock_check(self))
         return NULL;
 
-    if (find_sem_ptr(pysem, (void **)&semp) < 0)
+    if (PyObject_GetBuffer(data, &buf, PyBUF_SIMPLE) < 0)
         return NULL;
 
-    if (sem_getvalue(semp, &val) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    if (buf.len > self->header->capacity) {
+        PyBuffer_Release(&buf);
+        PyErr_SetString(PyExc_ValueError, "data is larger than the payload");
         return NULL;
     }
 
-    return PyInt_FromLong((long)val);
+    if (seqlock_begin(self)) {
+        PyBuffer_Release(&buf);
+        return NULL;
+    }
+    memcpy(self->data, buf.buf, buf.len);
+    seqlock_end(self, (uint32_t)buf.len);
+
+    PyBuffer_Release(&buf);
+
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
 static PyObject *
-python_sem_post(PyObject *module, PyObject *args) {
-    PyObject *pysem;
-    sem_t *semp;
-
-    if (!PyArg_ParseTuple(args, "O", &pysem))
-        return NULL;
+python_seqlock_write_reset(python_seqlock_object *self, PyObject *iamnull) {
+    uint64_t seq;
 
-    if (find_sem_ptr(pysem, (void **)&semp) < 0)
+    if (seqlock_check(self))
         return NULL;
 
-    if (sem_post(semp) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
+    if (self->writing) {
+        PyErr_SetString(PyExc_ValueError, "write already begun");
         return NULL;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    /* there's no telling a dead writer from a slow one, that's on the caller.
+     * the CAS at least can't undo a write that finished meanwhile. */
+    seq = __atomic_load_n(&self->header->seq, __ATOMIC_RELAXED);
+    return PyBool_FromLong(seq & 1 && __atomic_compare_exchange_n(
+                &self->header->seq, &seq, seq + 1, 0, __ATOMIC_RELEASE,
+                __ATOMIC_RELAXED));
 }
 
-static char *semwait_kwargs[] = {"sem", "try", "timeout", NULL};
+static char *seqlock_read_kwargs[] = {"retries", NULL};
 
 static PyObject *
-python_sem_wait(PyObject *module, PyObject *args, PyObject *kwargs) {
-    PyObject *pysem, *pytry = Py_False;
-    sem_t *semp;
-    double dtimeout = -1;
-    struct timespec timeout;
-    int rc;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Od", semwait_kwargs,
-                &pysem, &pytry, &dtimeout))
+python_seqlock_read_snapshot(python_seqlock_object *self, PyObject *args,
+        PyObject *kwargs) {
+    int retries = 1000, attempt;
+    seqlock_header *header;
+    uint64_t before, after;
+    uint32_t length;
+    PyObject *result = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", seqlock_read_kwargs,
+                &retries))
         return NULL;
 
-    if (find_sem_ptr(pysem, (void **)&semp))
+    if (seqlock_check(self))
         return NULL;
-
-    if (PyObject_IsTrue(pytry)) {
-        if (dtimeout > 0) {
-            PyErr_SetString(PyExc_ValueError,
-                    "both 'try' and 'timeout' can not be provided");
-            return NULL;
+    header = self->header;
+
+    for (attempt = 0; attempt <= retries; ++attempt) {
+        before = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            /* a writer is mid-update, give it a chance to finish */
+            if (attempt) sched_yield();
+            continue;
         }
-        rc = sem_trywait(semp);
-    } else if (dtimeout > 0) {
-        if (abs_timespec_ify(dtimeout, &timeout) < 0) {
-            PyErr_SetString(PyExc_ValueError, "bad timeout float");
-            return NULL;
+
+        length = __atomic_load_n(&header->length, __ATOMIC_RELAXED);
+        if (length > header->capacity)
+            continue;
+
+        /* a torn length from a write we'll retry over could be anything up
+         * to the capacity, so this has to come first */
+        if (NULL == result || PyString_GET_SIZE(result) != length) {
+            Py_XDECREF(result);
+            if (NULL == (result = PyString_FromStringAndSize(NULL, length)))
+                return NULL;
         }
-        rc = sem_timedwait(semp, &timeout);
-    } else
-        rc = sem_wait(semp);
+        memcpy(PyString_AS_STRING(result), self->data, length);
 
-    if (rc < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
-        return NULL;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&header->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            return result;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    Py_XDECREF(result);
+    errno = EAGAIN;
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
 }
 
-static char *shmopen_kwargs[] = {"name", "flags", "mode", NULL};
-
 static PyObject *
-python_shm_open(PyObject *module, PyObject *args, PyObject *kwargs) {
-    char *name;
-    int flags = 0, fd;
-    unsigned int mode = 0;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iI", shmopen_kwargs,
-                &name, &flags, &mode))
+python_seqlock_close(python_seqlock_object *self, PyObject *iamnull) {
+    if (self->exports) {
+        PyErr_SetString(PyExc_BufferError,
+                "cannot close a Seqlock with views still in use");
         return NULL;
+    }
 
-    if ((fd = shm_open(name, flags, (mode_t)mode)) < 0) {
+    if (self->writing)
+        seqlock_end(self, self->header->length);
+
+    if (NULL != self->header && munmap(self->header, self->mapsize) < 0) {
+        self->header = NULL;
         PyErr_SetFromErrno(PyExc_OSError);
         return NULL;
     }
+    self->header = NULL;
 
-    return PyInt_FromLong((long)fd);
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
-static PyObject *
-python_shm_unlink(PyObject *module, PyObject *args) {
-    char *name;
+static Py_ssize_t
+python_seqlock_length(python_seqlock_object *self) {
+    if (seqlock_check(self))
+        return -1;
 
-    if (!PyArg_ParseTuple(args, "s", &name))
-        return NULL;
+    return (Py_ssize_t)self->header->capacity;
+}
 
-    if (shm_unlink(name) < 0) {
-        PyErr_SetFromErrno(PyExc_OSError);
-        return NULL;
+static int
+python_seqlock_getbuf(python_seqlock_object *self, Py_buffer *buf,
+        int flags) {
+    if (!self->viewable) {
+        PyErr_SetString(PyExc_BufferError,
+                "Seqlock memory is only viewable through write_begin()");
+        buf->obj = NULL;
+        return -1;
     }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    if (PyBuffer_FillInfo(buf, (PyObject *)self, self->data,
+                (Py_ssize_t)self->header->capacity, 0, flags) < 0)
+        return -1;
+
+    self->exports++;
+    return 0;
+}
+
+static void
+python_seqlock_releasebuf(python_seqlock_object *self, Py_buffer *buf) {
+    self->exports--;
 }
 
+static PyBufferProcs python_seqlockbuf = {
+#if PY_MAJOR_VERSION < 3
+    0,
+    0,
+    0,
+    0,
+#endif
+    (getbufferproc)python_seqlock_getbuf,
+    (releasebufferproc)python_seqlock_releasebuf
+};
+
+static PySequenceMethods seqlock_as_sequence = {
+    (lenfunc)python_seqlock_length,            /* sq_length */
+};
+
+static PyMethodDef seqlock_methods[] = {
+    {"write_begin", (PyCFunction)python_seqlock_write_begin, METH_NOARGS,
+        "start updating the payload in place\n\
+\n\
+readers retry until the matching :meth:`write_end`, so keep it short. only\n\
+one write can be under way at a time, across all processes: if there's\n\
+another this fails with ``EBUSY``.\n\
+\n\
+:returns:\n\
+    a writable memoryview of the whole payload area. it must not be written\n\
+    to after :meth:`write_end`.\n\
+"},
+    {"write_end", (PyCFunction)python_seqlock_write_end,
+        METH_VARARGS | METH_KEYWORDS,
+        "finish updating the payload, publishing it to readers\n\
+\n\
+:param int size:\n\
+    the length of the new payload. defaults to leaving it as it was.\n\
+"},
+    {"write", (PyCFunction)python_seqlock_write, METH_O,
+        "replace the payload\n\
+\n\
+this is :meth:`write_begin`, a copy and :meth:`write_end` in one call.\n\
+\n\
+:param data: a bytes-like object, no longer than the Seqlock's ``size``\n\
+"},
+    {"write_reset", (PyCFunction)python_seqlock_write_reset, METH_NOARGS,
+        "abandon a write left unfinished by a writer that died\n\
+\n\
+only call this once that writer is known to be gone: a write still under\n\
+way would go on changing the payload under readers. the payload may be\n\
+half updated, so follow up with a fresh :meth:`write`.\n\
+\n\
+:returns: ``True`` if there was a write to abandon, otherwise ``False``\n\
+"},
+    {"read_snapshot", (PyCFunction)python_seqlock_read_snapshot,
+        METH_VARARGS | METH_KEYWORDS,
+        "copy out a consistent payload\n\
+\n\
+:param int retries:\n\
+    the most times to start over because a write got in the way, defaults\n\
+    to 1000. after that this fails with ``EAGAIN``. if the writer died\n\
+    mid-update every read fails that way until :meth:`write_reset`.\n\
+\n\
+:returns: the payload as a bytes object\n\
+"},
+    {"close", (PyCFunction)python_seqlock_close, METH_NOARGS,
+        "unmap the shared memory, ending any write in progress\n\
+\n\
+the segment itself stays until it's removed with :func:`shm_unlink`.\n\
+"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject python_seqlock_type = {
+    PyObject_HEAD_INIT(&PyType_Type)
+#if PY_MAJOR_VERSION < 3
+    0,                                         /* ob_size */
+#endif
+    "penguin.posix_ipc.Seqlock",               /* tp_name */
+    sizeof(python_seqlock_object),             /* tp_basicsize */
+    0,                                         /* tp_itemsize */
+    (destructor)python_seqlock_dealloc,        /* tp_dealloc */
+    0,                                         /* tp_print */
+    0,                                         /* tp_getattr */
+    0,                                         /* tp_setattr */
+    0,                                         /* tp_compare */
+    0,                                         /* tp_repr */
+    0,                                         /* tp_as_number */
+    &seqlock_as_sequence,                      /* tp_as_sequence */
+    0,                                         /* tp_as_mapping */
+    0,                                         /* tp_hash */
+    0,                                         /* tp_call */
+    0,                                         /* tp_str */
+    0,                                         /* tp_getattro */
+    0,                                         /* tp_setattro */
+    &python_seqlockbuf,                        /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT |
+#if PY_MAJOR_VERSION < 3
+    Py_TPFLAGS_HAVE_NEWBUFFER,                 /* tp_flags */
+#else
+    0,                                         /* tp_flags */
+#endif
+    "Seqlock(name, size=0, mode=0600)\n\
+\n\
+a payload of up to ``size`` bytes in a named shared memory segment, for\n\
+data that many processes read and one occasionally rewrites\n\
+\n\
+with a ``size`` the segment is created, failing if it already exists,\n\
+otherwise an existing one is opened. readers never block a writer and never\n\
+write to the shared memory themselves.\n\
+\n\
+``len()`` is the payload capacity.",       /* tp_doc */
+    0,                                         /* tp_traverse */
+    0,                                         /* tp_clear */
+    0,                                         /* tp_richcompare */
+    0,                                         /* tp_weaklistoffset */
+    0,                                         /* tp_iter */
+    0,                                         /* tp_iternext */
+    seqlock_methods,                           /* tp_methods */
+    0,                                         /* tp_members */
+    0,                                         /* tp_getset */
+    0,                                         /* tp_base */
+    0,                                         /* tp_dict */
+    0,                                         /* tp_descr_get */
+    0,                                         /* tp_descr_set */
+    0,                                         /* tp_dictoffset */
+    0,                                         /* tp_init */
+    PyType_GenericAlloc,                       /* tp_alloc */
+    python_seqlock_new,                        /* tp_new */
+    PyObject_Del,                              /* tp_free */
+};
+
 
 static PyMethodDef module_methods[] = {
     {"mq_open", (PyCFunction)python_mq_open, METH_VARARGS | METH_KEYWORDS,
@@ -620,14 +4151,67 @@ see the mq_receive(3) and mq_timedreceive(3) man pages for more details.\n\
 :param float timeout: optional maximum time to block waiting.\n\
 \n\
 :param int sizehint:\n\
-    optional maximum message size to support. defaults to the highest\n\
-    ``msgsize_max`` that the system will allow, but the max message size for\n\
-    this individual queue might have been set differently, in which case\n\
-    less memory could be used.\n\
+    optional maximum message size to support. defaults to the queue's\n\
+    ``mq_msgsize``, which costs an extra mq_getattr(3) call.\n\
 \n\
 :returns:\n\
     a two-tuple of the priority with which the message was sent and the\n\
     string message itself.\n\
+"},
+    {"mq_receive_into", (PyCFunction)python_mq_receive_into,
+        METH_VARARGS | METH_KEYWORDS,
+        "pull a message off of a queue into an existing buffer\n\
+\n\
+unlike :func:`mq_receive` this allocates nothing, so a consumer can reuse\n\
+one buffer for every message.\n\
+\n\
+:param int mqdes: the queue descriptor, from :func:`mq_open`.\n\
+\n\
+:param buffer:\n\
+    a writable buffer (such as a ``bytearray``) at least as large as the\n\
+    queue's ``mq_msgsize``.\n\
+\n\
+:param float timeout: optional maximum time to block waiting.\n\
+\n\
+:returns:\n\
+    a two-tuple of the priority with which the message was sent and the\n\
+    number of bytes written to the start of ``buffer``.\n\
+"},
+    {"mq_send_many", (PyCFunction)python_mq_send_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "put a batch of messages onto a queue\n\
+\n\
+the messages are sent one after another in a single call without the GIL.\n\
+\n\
+:param int mqdes: the queue descriptor, from :func:`mq_open`.\n\
+\n\
+:param msgs: a sequence of ``(msg, msg_prio)`` two-tuples.\n\
+\n\
+:param float timeout:\n\
+    optional maximum time to block waiting for space, for the whole batch.\n\
+\n\
+:returns:\n\
+    the number of messages sent. this is short of ``len(msgs)`` only when\n\
+    the queue filled up (a nonblocking descriptor or an expired timeout)\n\
+    after at least one message went through; otherwise errors are raised.\n\
+"},
+    {"mq_receive_many", (PyCFunction)python_mq_receive_many,
+        METH_VARARGS | METH_KEYWORDS,
+        "pull a batch of messages off of a queue\n\
+\n\
+this waits for the first message like :func:`mq_receive`, then takes any\n\
+others already waiting without blocking, all in one call without the GIL.\n\
+\n\
+:param int mqdes: the queue descriptor, from :func:`mq_open`.\n\
+\n\
+:param int max:\n\
+    the most messages to take (default 64). the queue's ``mq_maxmsg`` is\n\
+    also a limit.\n\
+\n\
+:param float timeout: optional maximum time to block for the first message.\n\
+\n\
+:returns:\n\
+    a list of ``(priority, message)`` two-tuples, in the order received.\n\
 "},
     {"mq_getattr", (PyCFunction)python_mq_getattr, METH_VARARGS,
         "get the properties of a message queue and its descriptor\n\
@@ -649,7 +4233,7 @@ see the man page for mq_getattr(3) for more details.\n\
         current number of messages on the queue\n\
 \n\
     a :class:`mq_attr<penguin.structs.mq_attr>` instance is actually\n\
-    returned, which is a namedtuple wrapper.\n\
+    returned, which is a struct sequence wrapper.\n\
 "},
     {"mq_setattr", (PyCFunction)python_mq_setattr, METH_VARARGS,
         "set attrbutes of a queue\n\
@@ -681,6 +4265,30 @@ signature a bit.\n\
     unregistered as notification target if it is already registered, and in\n\
     the latter case it will register using ``SIGEV_SIGNAL`` and the given\n\
     signal number.\n\
+\n\
+either way, this replaces a registration made with\n\
+:func:`mq_notify_eventfd`.\n\
+"},
+    {"mq_notify_eventfd", (PyCFunction)python_mq_notify_eventfd,
+        METH_VARARGS | METH_KEYWORDS,
+        "register for notification through an eventfd\n\
+\n\
+when a message arrives on the empty queue, 1 is added to the eventfd's\n\
+counter from a helper thread. unlike a one-shot :func:`mq_notify`\n\
+registration this re-arms itself each time, before the eventfd is written,\n\
+so a reader that wakes up and drains the queue will hear about the next\n\
+message too. no signal handler is involved, and the eventfd can be waited\n\
+on from any thread or event loop.\n\
+\n\
+:func:`mq_notify` with ``signo=0`` unregisters, as does :func:`mq_close`.\n\
+the registration holds a duplicate of the eventfd, so closing the caller's\n\
+copy doesn't end it.\n\
+\n\
+:param int mqdes: queue descriptor (as returned by :func:`mq_open`).\n\
+\n\
+:param eventfd:\n\
+    the eventfd to notify, an integer file descriptor or an object with a\n\
+    ``fileno()`` method such as :class:`penguin.fds.Eventfd`.\n\
 "},
     {"sem_open", (PyCFunction)python_sem_open, METH_VARARGS | METH_KEYWORDS,
         "initialize and open a named semaphore\n\
@@ -820,6 +4428,236 @@ see the shm_open(3) man page for more details.\n\
 see the shm_unlink(3) man page for better detail.\n\
 \n\
 :param str name: the '/' prefixed shared memory segment name to remove.\n\
+"},
+    {"futex_wait", (PyCFunction)python_futex_wait,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait on a 32 bit word in shared memory\n\
+\n\
+this sleeps, without the GIL, as long as the word holds ``expected`` and\n\
+nobody calls :func:`futex_wake` on it. see futex(2) for the details. futexes\n\
+are shared between processes, so the memory can be a\n\
+:func:`penguin.sysv_ipc.shmat` memoryview or an ``mmap`` of a\n\
+:func:`shm_open` segment.\n\
+\n\
+:param buf: any object supporting the buffer protocol\n\
+\n\
+:param int offset: the 4 byte aligned offset of the word in ``buf``\n\
+\n\
+:param int expected: the value that means the caller should keep waiting\n\
+\n\
+:param float timeout:\n\
+    the longest to wait, in seconds. negative (the default) waits\n\
+    indefinitely.\n\
+\n\
+:returns:\n\
+    False if the timeout ran out, otherwise True. that includes returning\n\
+    right away because the word didn't hold ``expected``, and spurious\n\
+    wakeups, so the caller should always check the word again.\n\
+"},
+    {"futex_wake", (PyCFunction)python_futex_wake,
+        METH_VARARGS | METH_KEYWORDS,
+        "wake processes waiting on a 32 bit word in shared memory\n\
+\n\
+:param buf: any object supporting the buffer protocol\n\
+\n\
+:param int offset: the 4 byte aligned offset of the word in ``buf``\n\
+\n\
+:param int count: the most waiters to wake, defaults to 1\n\
+\n\
+:returns: the number of waiters woken\n\
+"},
+#ifndef FUTEX_WAITV_MISSING
+    {"futex_waitv", (PyCFunction)python_futex_waitv,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait on several 32 bit words at once\n\
+\n\
+see :func:`futex_wait`. this needs linux 5.16 or later.\n\
+\n\
+:param waiters:\n\
+    a sequence of up to 128 ``(buf, offset, expected)`` triples, as for the\n\
+    arguments of :func:`futex_wait`\n\
+\n\
+:param float timeout:\n\
+    the longest to wait, in seconds. negative (the default) waits\n\
+    indefinitely.\n\
+\n\
+:returns:\n\
+    the index in ``waiters`` of a word that was woken or didn't hold its\n\
+    expected value, -1 if interrupted by a signal, or None if the timeout ran\n\
+    out\n\
+"},
+#endif
+    {"mutex_init", (PyCFunction)python_mutex_init,
+        METH_VARARGS | METH_KEYWORDS,
+        "initialize a process-shared, robust mutex\n\
+\n\
+see pthread_mutex_init(3) and pthread_mutexattr_setrobust(3).\n\
+\n\
+:param lock:\n\
+    the memory the mutex lives in. this can be a memoryview returned from\n\
+    :func:`penguin.sysv_ipc.shmat`, an ``mmap`` object (for instance of a\n\
+    :func:`shm_open` segment) or anything else with a writable buffer, or an\n\
+    integer address.\n\
+\n\
+:param int offset:\n\
+    the position of the mutex in ``lock``, defaults to 0. it must be suitably\n\
+    aligned, and have room for a ``pthread_mutex_t``.\n\
+"},
+    {"mutex_lock", (PyCFunction)python_mutex_lock,
+        METH_VARARGS | METH_KEYWORDS,
+        "lock a mutex set up with :func:`mutex_init`\n\
+\n\
+:param lock: the memory the mutex lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the mutex in ``lock``, defaults to 0\n\
+\n\
+:param bool try:\n\
+    if ``True`` and the mutex is held, fail with ``EBUSY`` instead of\n\
+    waiting. defaults to ``False``.\n\
+\n\
+:param float timeout:\n\
+    optional maximum time to wait, in seconds, before failing with\n\
+    ``ETIMEDOUT``. defaults to no limit.\n\
+\n\
+:returns:\n\
+    ``True`` if the mutex's previous owner died holding it. the mutex has\n\
+    been made consistent again, but the data it protects may need repair.\n\
+    otherwise ``False``.\n\
+"},
+    {"mutex_unlock", (PyCFunction)python_mutex_unlock,
+        METH_VARARGS | METH_KEYWORDS,
+        "unlock a mutex\n\
+\n\
+:param lock: the memory the mutex lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the mutex in ``lock``, defaults to 0\n\
+"},
+    {"mutex_destroy", (PyCFunction)python_mutex_destroy,
+        METH_VARARGS | METH_KEYWORDS,
+        "destroy an unlocked mutex\n\
+\n\
+:param lock: the memory the mutex lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the mutex in ``lock``, defaults to 0\n\
+"},
+    {"cond_init", (PyCFunction)python_cond_init,
+        METH_VARARGS | METH_KEYWORDS,
+        "initialize a process-shared condition variable\n\
+\n\
+see pthread_cond_init(3). timed waits on it use ``CLOCK_MONOTONIC``.\n\
+\n\
+:param cond:\n\
+    the memory the condition variable lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset:\n\
+    the position of the condition variable in ``cond``, defaults to 0\n\
+"},
+    {"cond_wait", (PyCFunction)python_cond_wait,
+        METH_VARARGS | METH_KEYWORDS,
+        "wait on a condition variable\n\
+\n\
+the mutex must be locked, and is unlocked for the wait and locked again\n\
+before this returns. if the mutex's owner died in the meantime it's made\n\
+consistent again and the wait counts as a wakeup, as with :func:`mutex_lock`.\n\
+\n\
+:param cond: the memory the condition variable lives in\n\
+\n\
+:param int offset: the position of the condition variable in ``cond``\n\
+\n\
+:param mutex: the memory the mutex lives in\n\
+\n\
+:param int mutex_offset:\n\
+    the position of the mutex in ``mutex``, defaults to 0\n\
+\n\
+:param float timeout:\n\
+    optional maximum time to wait, in seconds. defaults to no limit.\n\
+\n\
+:returns:\n\
+    a two-tuple ``(woken, owner_died)``. ``woken`` is ``False`` if the\n\
+    timeout ran out, otherwise ``True``; wakeups can be spurious, so check\n\
+    the condition again either way. ``owner_died`` is ``True`` if the\n\
+    mutex's previous owner died holding it, in which case the data it\n\
+    protects may need repair.\n\
+"},
+    {"cond_signal", (PyCFunction)python_cond_signal,
+        METH_VARARGS | METH_KEYWORDS,
+        "wake one waiter on a condition variable\n\
+\n\
+:param cond: the memory the condition variable lives in\n\
+\n\
+:param int offset:\n\
+    the position of the condition variable in ``cond``, defaults to 0\n\
+"},
+    {"cond_broadcast", (PyCFunction)python_cond_broadcast,
+        METH_VARARGS | METH_KEYWORDS,
+        "wake all waiters on a condition variable\n\
+\n\
+:param cond: the memory the condition variable lives in\n\
+\n\
+:param int offset:\n\
+    the position of the condition variable in ``cond``, defaults to 0\n\
+"},
+    {"cond_destroy", (PyCFunction)python_cond_destroy,
+        METH_VARARGS | METH_KEYWORDS,
+        "destroy a condition variable nobody is waiting on\n\
+\n\
+:param cond: the memory the condition variable lives in\n\
+\n\
+:param int offset:\n\
+    the position of the condition variable in ``cond``, defaults to 0\n\
+"},
+    {"rwlock_init", (PyCFunction)python_rwlock_init,
+        METH_VARARGS | METH_KEYWORDS,
+        "initialize a process-shared reader/writer lock\n\
+\n\
+see pthread_rwlock_init(3).\n\
+\n\
+:param lock: the memory the lock lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the lock in ``lock``, defaults to 0\n\
+\n\
+:param bool prefer_writers:\n\
+    by default new readers can share the lock while a writer waits, which\n\
+    keeps reads flowing but can starve writers. with ``True`` a waiting\n\
+    writer holds back new readers instead.\n\
+"},
+    {"rwlock_rdlock", (PyCFunction)python_rwlock_rdlock,
+        METH_VARARGS | METH_KEYWORDS,
+        "take a reader/writer lock for reading\n\
+\n\
+:param lock: the memory the lock lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the lock in ``lock``, defaults to 0\n\
+\n\
+:param bool try:\n\
+    if ``True`` and a writer holds the lock, fail with ``EBUSY`` instead of\n\
+    waiting. defaults to ``False``.\n\
+\n\
+:param float timeout:\n\
+    optional maximum time to wait, in seconds, before failing with\n\
+    ``ETIMEDOUT``. defaults to no limit.\n\
+"},
+    {"rwlock_wrlock", (PyCFunction)python_rwlock_wrlock,
+        METH_VARARGS | METH_KEYWORDS,
+        "take a reader/writer lock for writing\n\
+\n\
+arguments are as for :func:`rwlock_rdlock`.\n\
+"},
+    {"rwlock_unlock", (PyCFunction)python_rwlock_unlock,
+        METH_VARARGS | METH_KEYWORDS,
+        "release a reader/writer lock, whichever way it was taken\n\
+\n\
+:param lock: the memory the lock lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the lock in ``lock``, defaults to 0\n\
+"},
+    {"rwlock_destroy", (PyCFunction)python_rwlock_destroy,
+        METH_VARARGS | METH_KEYWORDS,
+        "destroy an unheld reader/writer lock\n\
+\n\
+:param lock: the memory the lock lives in, as for :func:`mutex_init`\n\
+\n\
+:param int offset: the position of the lock in ``lock``, defaults to 0\n\
 "},
     {NULL, NULL, 0, NULL}
 };
@@ -837,19 +4675,50 @@ PyMODINIT_FUNC
 PyInit_posix_ipc(void) {
     PyObject *module = PyModule_Create(&posix_ipc_module);
 
+    if (PyType_Ready(&python_mqselector_type)) return NULL;
+    if (PyType_Ready(&python_semaphore_type)) return NULL;
+    if (PyType_Ready(&python_ring_type)) return NULL;
+    if (PyType_Ready(&python_shmqueue_type)) return NULL;
+    if (PyType_Ready(&python_seqlock_type)) return NULL;
+
 #else
 
 PyMODINIT_FUNC
 initposix_ipc(void) {
     PyObject *module = Py_InitModule("penguin.posix_ipc", module_methods);
 
+    if (PyType_Ready(&python_mqselector_type)) return;
+    if (PyType_Ready(&python_semaphore_type)) return;
+    if (PyType_Ready(&python_ring_type)) return;
+    if (PyType_Ready(&python_shmqueue_type)) return;
+    if (PyType_Ready(&python_seqlock_type)) return;
+
 #endif
 
-    get_msgsizemax();
+    if (!mq_attr_ready) {
+        PyStructSequence_InitType(&mq_attr_type, &mq_attr_desc);
+        structseq_take_fields(&mq_attr_type);
+        mq_attr_ready = 1;
+    }
+    Py_INCREF(&mq_attr_type);
+    PyModule_AddObject(module, "mq_attr", (PyObject *)&mq_attr_type);
+
+    Py_INCREF(&python_mqselector_type);
+    PyModule_AddObject(module, "MQSelector",
+            (PyObject *)&python_mqselector_type);
+
+    Py_INCREF(&python_semaphore_type);
+    PyModule_AddObject(module, "Semaphore",
+            (PyObject *)&python_semaphore_type);
+
+    Py_INCREF(&python_ring_type);
+    PyModule_AddObject(module, "Ring", (PyObject *)&python_ring_type);
+
+    Py_INCREF(&python_shmqueue_type);
+    PyModule_AddObject(module, "ShmQueue", (PyObject *)&python_shmqueue_type);
 
-    PyObject *structs = PyImport_ImportModule("penguin.structs");
-    if (NULL != structs && PyObject_HasAttrString(structs, "mq_attr"))
-        py_mq_attr = PyObject_GetAttrString(structs, "mq_attr");
+    Py_INCREF(&python_seqlock_type);
+    PyModule_AddObject(module, "Seqlock", (PyObject *)&python_seqlock_type);
 
     PyObject *sysvipc = PyImport_ImportModule("penguin.sysv_ipc");
     if (NULL != sysvipc && PyObject_HasAttrString(sysvipc, "_shm_type"))
@@ -0,0 +1,71 @@
+/*
+ * construction of the result struct sequences
+ *
+ * a struct sequence type is built from one sequence holding all its fields.
+ * penguin's result types used to be namedtuples, built from the fields
+ * themselves, positionally or by name, so that is accepted as well.
+ */
+
+static newfunc structseq_base_new = NULL;
+
+static PyObject *
+structseq_fields_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *fields, *item, *packed, *result;
+    Py_ssize_t i, n, nargs = PyTuple_GET_SIZE(args), used = 0;
+
+    /* the struct sequence's own (sequence[, dict]) */
+    if (1 == nargs && (NULL == kwargs || !PyDict_Size(kwargs)))
+        return structseq_base_new(type, args, kwargs);
+
+    for (n = 0; NULL != type->tp_members[n].name; ++n);
+
+    if (nargs > n) {
+        PyErr_Format(PyExc_TypeError, "%s() takes at most %d arguments",
+                type->tp_name, (int)n);
+        return NULL;
+    }
+
+    if (NULL == (fields = PyTuple_New(n)))
+        return NULL;
+
+    for (i = 0; i < n; ++i) {
+        if (i < nargs)
+            item = PyTuple_GET_ITEM(args, i);
+        else if (NULL != kwargs && NULL != (item = PyDict_GetItemString(
+                        kwargs, type->tp_members[i].name)))
+            ++used;
+        else {
+            PyErr_Format(PyExc_TypeError, "%s() missing field '%s'",
+                    type->tp_name, type->tp_members[i].name);
+            Py_DECREF(fields);
+            return NULL;
+        }
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(fields, i, item);
+    }
+
+    if (NULL != kwargs && used != PyDict_Size(kwargs)) {
+        PyErr_Format(PyExc_TypeError,
+                "%s() got an unexpected or repeated keyword argument",
+                type->tp_name);
+        Py_DECREF(fields);
+        return NULL;
+    }
+
+    packed = PyTuple_Pack(1, fields);
+    Py_DECREF(fields);
+    if (NULL == packed)
+        return NULL;
+
+    result = structseq_base_new(type, packed, NULL);
+    Py_DECREF(packed);
+    return result;
+}
+
+/* call on a type after PyStructSequence_InitType */
+static void
+structseq_take_fields(PyTypeObject *type) {
+    if (NULL == structseq_base_new)
+        structseq_base_new = type->tp_new;
+    type->tp_new = structseq_fields_new;
+}
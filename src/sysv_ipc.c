@@ -1,4 +1,5 @@
 #include "src/common.h"
+#include "src/structseq.h"
 
 #include <sys/ipc.h>
 #include <sys/msg.h>
@@ -9,14 +10,82 @@
 #include <unistd.h>
 
 
-/* set these to penguin.structs.* at import time */
-static PyObject *PyIpcPerm = NULL;
-static PyObject *PyMsqidDs = NULL;
-static PyObject *PySemidDs = NULL;
-static PyObject *PyShmidDs = NULL;
-static PyObject *PyMsgInfo = NULL;
-static PyObject *PySemInfo = NULL;
-static PyObject *PyShmInfo = NULL;
+/* result types, also exported as penguin.structs.* */
+static PyStructSequence_Field ipc_perm_fields[] = {
+    {"key", NULL}, {"uid", NULL}, {"gid", NULL}, {"cuid", NULL},
+    {"cgid", NULL}, {"mode", NULL}, {"seq", NULL}, {NULL}
+};
+static PyStructSequence_Desc ipc_perm_desc = {
+    "penguin.sysv_ipc.ipc_perm", "ownership and permissions of an IPC object",
+    ipc_perm_fields, 7
+};
+static PyTypeObject ipc_perm_type;
+
+static PyStructSequence_Field msqid_ds_fields[] = {
+    {"msg_perm", NULL}, {"msg_stime", NULL}, {"msg_rtime", NULL},
+    {"msg_ctime", NULL}, {"msg_cbytes", NULL}, {"msg_qnum", NULL},
+    {"msg_qbytes", NULL}, {"msg_lspid", NULL}, {"msg_lrpid", NULL}, {NULL}
+};
+static PyStructSequence_Desc msqid_ds_desc = {
+    "penguin.sysv_ipc.msqid_ds", "message queue metadata",
+    msqid_ds_fields, 9
+};
+static PyTypeObject msqid_ds_type;
+
+static PyStructSequence_Field semid_ds_fields[] = {
+    {"sem_perm", NULL}, {"sem_otime", NULL}, {"sem_ctime", NULL},
+    {"sem_nsems", NULL}, {NULL}
+};
+static PyStructSequence_Desc semid_ds_desc = {
+    "penguin.sysv_ipc.semid_ds", "semaphore set metadata",
+    semid_ds_fields, 4
+};
+static PyTypeObject semid_ds_type;
+
+static PyStructSequence_Field shmid_ds_fields[] = {
+    {"shm_perm", NULL}, {"shm_segsz", NULL}, {"shm_atime", NULL},
+    {"shm_dtime", NULL}, {"shm_ctime", NULL}, {"shm_cpid", NULL},
+    {"shm_lpid", NULL}, {"shm_nattch", NULL}, {NULL}
+};
+static PyStructSequence_Desc shmid_ds_desc = {
+    "penguin.sysv_ipc.shmid_ds", "shared memory segment metadata",
+    shmid_ds_fields, 8
+};
+static PyTypeObject shmid_ds_type;
+
+static PyStructSequence_Field msginfo_fields[] = {
+    {"msgpool", NULL}, {"msgmap", NULL}, {"msgmax", NULL}, {"msgmnb", NULL},
+    {"msgmni", NULL}, {"msgssz", NULL}, {"msgtql", NULL}, {"msgseg", NULL},
+    {NULL}
+};
+static PyStructSequence_Desc msginfo_desc = {
+    "penguin.sysv_ipc.msginfo", "system-wide message queue limits",
+    msginfo_fields, 8
+};
+static PyTypeObject msginfo_type;
+
+static PyStructSequence_Field seminfo_fields[] = {
+    {"semmap", NULL}, {"semmni", NULL}, {"semmns", NULL}, {"semmnu", NULL},
+    {"semmsl", NULL}, {"semopm", NULL}, {"semume", NULL}, {"semusz", NULL},
+    {"semvmx", NULL}, {"semaem", NULL}, {NULL}
+};
+static PyStructSequence_Desc seminfo_desc = {
+    "penguin.sysv_ipc.seminfo", "system-wide semaphore limits",
+    seminfo_fields, 10
+};
+static PyTypeObject seminfo_type;
+
+static PyStructSequence_Field shm_info_fields[] = {
+    {"used_ids", NULL}, {"shm_tot", NULL}, {"shm_rss", NULL},
+    {"shm_swp", NULL}, {NULL}
+};
+static PyStructSequence_Desc shm_info_desc = {
+    "penguin.sysv_ipc.shm_info", "system-wide shared memory usage",
+    shm_info_fields, 4
+};
+static PyTypeObject shm_info_type;
+
+static int struct_types_ready = 0;
 
 /* memory page size. this will be the default max size for msgrcv */
 static int pagesize;
@@ -44,179 +113,175 @@ static int pagesize;
 
 static PyObject *
 pythonify_ipcperm(struct ipc_perm *perm) {
-    PyObject *obj, *args, *pyperm;
+    PyObject *obj, *result;
 
-    if (NULL == (args = PyTuple_New(7))) return NULL;
+    if (NULL == (result = PyStructSequence_New(&ipc_perm_type))) return NULL;
 
     if (NULL == (obj = PyInt_FromLong((long)perm->key & 0xffffffff)))
         goto fail;
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->uid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->gid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->cuid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->cgid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 4, obj);
+    PyStructSequence_SET_ITEM(result, 4, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->mode)))
         goto fail;
-    PyTuple_SET_ITEM(args, 5, obj);
+    PyStructSequence_SET_ITEM(result, 5, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)perm->seq)))
         goto fail;
-    PyTuple_SET_ITEM(args, 6, obj);
+    PyStructSequence_SET_ITEM(result, 6, obj);
 
-    pyperm = PyObject_Call(PyIpcPerm, args, NULL);
-    Py_DECREF(args);
-    return pyperm;
+    return result;
 
 fail:
-    Py_DECREF(args);
+    Py_DECREF(result);
     return NULL;
 }
 
 static PyObject *
 pythonify_mqds(struct msqid_ds *mqds) {
-    PyObject *obj, *args, *result;
+    PyObject *obj, *result;
 
     if (NULL == (obj = pythonify_ipcperm(&mqds->msg_perm)))
         return NULL;
 
-    if (NULL == (args = PyTuple_New(9))) {
+    if (NULL == (result = PyStructSequence_New(&msqid_ds_type))) {
         Py_DECREF(obj);
         return NULL;
     }
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)mqds->msg_stime)))
         goto fail;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)mqds->msg_rtime)))
         goto fail;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)mqds->msg_ctime)))
         goto fail;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong(mqds->msg_cbytes)))
         goto fail;
-    PyTuple_SET_ITEM(args, 4, obj);
+    PyStructSequence_SET_ITEM(result, 4, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong((unsigned long)mqds->msg_qnum)))
         goto fail;
-    PyTuple_SET_ITEM(args, 5, obj);
+    PyStructSequence_SET_ITEM(result, 5, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong((unsigned long)mqds->msg_qbytes)))
         goto fail;
-    PyTuple_SET_ITEM(args, 6, obj);
+    PyStructSequence_SET_ITEM(result, 6, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)mqds->msg_lspid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 7, obj);
+    PyStructSequence_SET_ITEM(result, 7, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)mqds->msg_lrpid)))
         goto fail;
-    PyTuple_SET_ITEM(args, 8, obj);
+    PyStructSequence_SET_ITEM(result, 8, obj);
 
-    result = PyObject_Call(PyMsqidDs, args, NULL);
-    Py_DECREF(args);
     return result;
 
 fail:
-    Py_DECREF(args);
+    Py_DECREF(result);
     return NULL;
 }
 
 static PyObject *
 pythonify_sds(struct semid_ds *sds) {
-    PyObject *obj, *args, *result = NULL;
+    PyObject *obj, *result;
 
     if (NULL == (obj = pythonify_ipcperm(&sds->sem_perm)))
         return NULL;
 
-    if (NULL == (args = PyTuple_New(4))) {
+    if (NULL == (result = PyStructSequence_New(&semid_ds_type))) {
         Py_DECREF(obj);
         return NULL;
     }
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->sem_otime)))
         goto end;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->sem_ctime)))
         goto end;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong(sds->sem_nsems)))
         goto end;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
-    result = PyObject_Call(PySemidDs, args, NULL);
+    return result;
 
 end:
-    Py_DECREF(args);
-    return result;
+    Py_DECREF(result);
+    return NULL;
 }
 
 static PyObject *
 pythonify_shmds(struct shmid_ds *sds) {
-    PyObject *obj, *args, *result = NULL;
+    PyObject *obj, *result;
 
     if (NULL == (obj = pythonify_ipcperm(&sds->shm_perm)))
         return NULL;
 
-    if (NULL == (args = PyTuple_New(8))) {
+    if (NULL == (result = PyStructSequence_New(&shmid_ds_type))) {
         Py_DECREF(obj);
         return NULL;
     }
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyLong_FromSize_t(sds->shm_segsz)))
         goto end;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->shm_atime)))
         goto end;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->shm_dtime)))
         goto end;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->shm_ctime)))
         goto end;
-    PyTuple_SET_ITEM(args, 4, obj);
+    PyStructSequence_SET_ITEM(result, 4, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->shm_cpid)))
         goto end;
-    PyTuple_SET_ITEM(args, 5, obj);
+    PyStructSequence_SET_ITEM(result, 5, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)sds->shm_lpid)))
         goto end;
-    PyTuple_SET_ITEM(args, 6, obj);
+    PyStructSequence_SET_ITEM(result, 6, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong((unsigned long)sds->shm_nattch)))
         goto end;
-    PyTuple_SET_ITEM(args, 7, obj);
+    PyStructSequence_SET_ITEM(result, 7, obj);
 
-    result = PyObject_Call(PyShmidDs, args, NULL);
+    return result;
 
 end:
-    Py_DECREF(args);
-    return result;
+    Py_DECREF(result);
+    return NULL;
 }
 
 static PyObject *
@@ -241,48 +306,48 @@ pythonify_semarray(unsigned short *semvals, unsigned long count) {
 
 static PyObject *
 pythonify_msginfo(struct msginfo *info) {
-    PyObject *obj, *args, *result = NULL;
+    PyObject *obj, *result;
 
-    if (NULL == (args = PyTuple_New(8)))
+    if (NULL == (result = PyStructSequence_New(&msginfo_type)))
         return NULL;
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgpool)))
         goto done;
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgmap)))
         goto done;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgmax)))
         goto done;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgmnb)))
         goto done;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgmni)))
         goto done;
-    PyTuple_SET_ITEM(args, 4, obj);
+    PyStructSequence_SET_ITEM(result, 4, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgssz)))
         goto done;
-    PyTuple_SET_ITEM(args, 5, obj);
+    PyStructSequence_SET_ITEM(result, 5, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgtql)))
         goto done;
-    PyTuple_SET_ITEM(args, 6, obj);
+    PyStructSequence_SET_ITEM(result, 6, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->msgseg)))
         goto done;
-    PyTuple_SET_ITEM(args, 7, obj);
+    PyStructSequence_SET_ITEM(result, 7, obj);
 
-    result = PyObject_Call(PyMsgInfo, args, NULL);
+    return result;
 
 done:
-    Py_DECREF(args);
-    return result;
+    Py_DECREF(result);
+    return NULL;
 }
 
 #endif
@@ -290,56 +355,56 @@ done:
 
 static PyObject *
 pythonify_seminfo(struct seminfo *info) {
-    PyObject *obj, *args, *result = NULL;
+    PyObject *obj, *result;
 
-    if (NULL == (args = PyTuple_New(10)))
+    if (NULL == (result = PyStructSequence_New(&seminfo_type)))
         return NULL;
 
     if (NULL == (obj = PyInt_FromLong((long)info->semmap)))
         goto done;
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semmni)))
         goto done;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semmns)))
         goto done;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semmnu)))
         goto done;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semmsl)))
         goto done;
-    PyTuple_SET_ITEM(args, 4, obj);
+    PyStructSequence_SET_ITEM(result, 4, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semopm)))
         goto done;
-    PyTuple_SET_ITEM(args, 5, obj);
+    PyStructSequence_SET_ITEM(result, 5, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semume)))
         goto done;
-    PyTuple_SET_ITEM(args, 6, obj);
+    PyStructSequence_SET_ITEM(result, 6, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semusz)))
         goto done;
-    PyTuple_SET_ITEM(args, 7, obj);
+    PyStructSequence_SET_ITEM(result, 7, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semvmx)))
         goto done;
-    PyTuple_SET_ITEM(args, 8, obj);
+    PyStructSequence_SET_ITEM(result, 8, obj);
 
     if (NULL == (obj = PyInt_FromLong((long)info->semaem)))
         goto done;
-    PyTuple_SET_ITEM(args, 9, obj);
+    PyStructSequence_SET_ITEM(result, 9, obj);
 
-    result = PyObject_Call(PySemInfo, args, NULL);
+    return result;
 
 done:
-    Py_DECREF(args);
-    return result;
+    Py_DECREF(result);
+    return NULL;
 }
 
 #endif
@@ -347,32 +412,32 @@ done:
 
 static PyObject *
 pythonify_shminfo(struct shm_info *info) {
-    PyObject *args, *obj, *result = NULL;
+    PyObject *result, *obj;
 
-    if (NULL == (args = PyTuple_New(4)))
+    if (NULL == (result = PyStructSequence_New(&shm_info_type)))
         return NULL;
 
     if (NULL == (obj = PyInt_FromLong((long)info->used_ids)))
         goto done;
-    PyTuple_SET_ITEM(args, 0, obj);
+    PyStructSequence_SET_ITEM(result, 0, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong(info->shm_tot)))
         goto done;
-    PyTuple_SET_ITEM(args, 1, obj);
+    PyStructSequence_SET_ITEM(result, 1, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong(info->shm_rss)))
         goto done;
-    PyTuple_SET_ITEM(args, 2, obj);
+    PyStructSequence_SET_ITEM(result, 2, obj);
 
     if (NULL == (obj = PyLong_FromUnsignedLong(info->shm_swp)))
         goto done;
-    PyTuple_SET_ITEM(args, 3, obj);
+    PyStructSequence_SET_ITEM(result, 3, obj);
 
-    result = PyObject_Call(PyShmInfo, args, NULL);
+    return result;
 
 done:
-    Py_DECREF(args);
-    return result;
+    Py_DECREF(result);
+    return NULL;
 }
 
 #endif
@@ -1243,7 +1308,7 @@ same key.\n\
 :returns:\n\
     ``None``, unless ``cmd`` was ``IPC_STAT``, in which case a\n\
     :class:`msqid_ds<penguin.structs.msqid_ds>` struct is returned. It is a\n\
-    namedtuple class with the same fields as ``struct msqid_ds`` as\n\
+    struct sequence with the same fields as ``struct msqid_ds`` as\n\
     described in the msgctl(2) man.\n\
 "},
     {"msgsnd", (PyCFunction)python_msgsnd, METH_VARARGS | METH_KEYWORDS,
@@ -1475,7 +1540,7 @@ this function actually uses semtimedop(2), to power the timeout\n\
 :returns:\n\
     ``None``, unless ``cmd`` was ``IPC_STAT``, in which case a\n\
     :class:`shmid_ds<penguin.structs.shmid_ds>` struct is returned. It is a\n\
-    namedtuple class with the same fields as ``struct shmid_ds`` as\n\
+    struct sequence with the same fields as ``struct shmid_ds`` as\n\
     described in the shmctl(2) man page.\n\
 "},
     {"shmat", (PyCFunction)python_shmat, METH_VARARGS | METH_KEYWORDS,
@@ -1576,31 +1641,38 @@ initsysv_ipc(void) {
     PyModule_AddIntConstant(module, "SEM_STAT", SEM_STAT);
 #endif
 
-    PyObject *structs = PyImport_ImportModule("penguin.structs");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "ipc_perm"))
-        PyIpcPerm = PyObject_GetAttrString(structs, "ipc_perm");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "msqid_ds"))
-        PyMsqidDs = PyObject_GetAttrString(structs, "msqid_ds");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "semid_ds"))
-        PySemidDs = PyObject_GetAttrString(structs, "semid_ds");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "shmid_ds"))
-        PyShmidDs = PyObject_GetAttrString(structs, "shmid_ds");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "msginfo"))
-        PyMsgInfo = PyObject_GetAttrString(structs, "msginfo");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "seminfo"))
-        PySemInfo = PyObject_GetAttrString(structs, "seminfo");
-
-    if (NULL != structs && PyObject_HasAttrString(structs, "shm_info"))
-        PyShmInfo = PyObject_GetAttrString(structs, "shm_info");
+    if (!struct_types_ready) {
+        PyStructSequence_InitType(&ipc_perm_type, &ipc_perm_desc);
+        PyStructSequence_InitType(&msqid_ds_type, &msqid_ds_desc);
+        PyStructSequence_InitType(&semid_ds_type, &semid_ds_desc);
+        PyStructSequence_InitType(&shmid_ds_type, &shmid_ds_desc);
+        PyStructSequence_InitType(&msginfo_type, &msginfo_desc);
+        PyStructSequence_InitType(&seminfo_type, &seminfo_desc);
+        PyStructSequence_InitType(&shm_info_type, &shm_info_desc);
+        structseq_take_fields(&ipc_perm_type);
+        structseq_take_fields(&msqid_ds_type);
+        structseq_take_fields(&semid_ds_type);
+        structseq_take_fields(&shmid_ds_type);
+        structseq_take_fields(&msginfo_type);
+        structseq_take_fields(&seminfo_type);
+        structseq_take_fields(&shm_info_type);
+        struct_types_ready = 1;
+    }
 
-    if (NULL == structs)
-        PyErr_Clear();
+    Py_INCREF(&ipc_perm_type);
+    PyModule_AddObject(module, "ipc_perm", (PyObject *)&ipc_perm_type);
+    Py_INCREF(&msqid_ds_type);
+    PyModule_AddObject(module, "msqid_ds", (PyObject *)&msqid_ds_type);
+    Py_INCREF(&semid_ds_type);
+    PyModule_AddObject(module, "semid_ds", (PyObject *)&semid_ds_type);
+    Py_INCREF(&shmid_ds_type);
+    PyModule_AddObject(module, "shmid_ds", (PyObject *)&shmid_ds_type);
+    Py_INCREF(&msginfo_type);
+    PyModule_AddObject(module, "msginfo", (PyObject *)&msginfo_type);
+    Py_INCREF(&seminfo_type);
+    PyModule_AddObject(module, "seminfo", (PyObject *)&seminfo_type);
+    Py_INCREF(&shm_info_type);
+    PyModule_AddObject(module, "shm_info", (PyObject *)&shm_info_type);
 
     PyType_Ready(&python_shm_type);
     PyModule_AddObject(module, "_shm_type", (PyObject *)&python_shm_type);